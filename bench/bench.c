@@ -0,0 +1,215 @@
+/* Keystroke replay benchmark.
+ *
+ * Runs the editor core headless against generated fixture files, replays
+ * each keystroke script through the real input decoder and draws a frame
+ * after every key, like the main loop does. Prints one JSON document with
+ * the timings of every script.
+ *
+ * Script format, one directive or key line per line:
+ *
+ *   # comment
+ *   %fixture 200000     fixture size in lines (default 100000)
+ *   %utf8               a fixture with non-ASCII text instead
+ *   %line 100000        cursor row before anything is replayed
+ *   %setup <End>        keys replayed untimed before the run
+ *   %repeat 5000        how often each key line below is replayed
+ *   x                   keys; one replay of a line is one op
+ *
+ * Keys are literal characters or <Name> tokens: <Enter> <Tab> <BS> <Del>
+ * <Up> <Down> <Left> <Right> <Home> <End> <PgUp> <PgDn> <S-Up> <S-Down>
+ * <S-Left> <S-Right> <Esc> <lt> and <C-x> for control keys. <Esc> only
+ * works at the end of a line, or it swallows the keys after it.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "draw.h"
+#include "editor.h"
+#include "editor_ops.h"
+#include "fileio.h"
+#include "journal.h"
+#include "loader.h"
+#include "userinput.h"
+#include "fixture.h"
+
+#define BENCH_ROWS 50
+#define BENCH_COLS 160
+#define BENCH_DEFAULT_LINES 100000
+
+struct benchScript {
+    char name[64];
+    int fixture_lines;
+    int utf8;
+    int line;
+    struct abuf setup;
+    struct abuf keys;
+    long ops;
+    long nkeys;
+};
+
+static long output_bytes = 0;
+
+/*** output ***/
+static void benchOutput(const char *s, int len) {
+    (void)s;
+    output_bytes += len;
+}
+
+static long long benchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*** scripts ***/
+static const struct {
+    const char *name;
+    const char *seq;
+} benchKeys[] = {
+    {"Enter", "\r"}, {"Tab", "\t"}, {"BS", "\x7f"}, {"Del", "\x1b[3~"},
+    {"Up", "\x1b[A"}, {"Down", "\x1b[B"}, {"Right", "\x1b[C"}, {"Left", "\x1b[D"},
+    {"Home", "\x1b[H"}, {"End", "\x1b[F"}, {"PgUp", "\x1b[5~"}, {"PgDn", "\x1b[6~"},
+    {"S-Up", "\x1b[1;2A"}, {"S-Down", "\x1b[1;2B"},
+    {"S-Right", "\x1b[1;2C"}, {"S-Left", "\x1b[1;2D"},
+    {"Esc", "\x1b"}, {"lt", "<"},
+};
+
+// Append the bytes for one line of keys, returning how many keys it held
+static int benchParseKeys(const char *path, int lineno, const char *s, struct abuf *out) {
+    int nkeys = 0;
+    while (*s) {
+        if (*s != '<') {
+            abAppend(out, s++, 1);
+            nkeys++;
+            continue;
+        }
+        const char *end = strchr(s, '>');
+        if (!end) break;
+        int len = end - s - 1;
+        const char *name = s + 1;
+        int found = 0;
+        if (len == 3 && name[0] == 'C' && name[1] == '-') {
+            char c = CTRL_KEY(name[2]);
+            abAppend(out, &c, 1);
+            found = 1;
+        }
+        for (size_t i = 0; !found && i < sizeof(benchKeys) / sizeof(benchKeys[0]); i++) {
+            if ((int)strlen(benchKeys[i].name) == len && !strncmp(benchKeys[i].name, name, len)) {
+                abAppend(out, benchKeys[i].seq, strlen(benchKeys[i].seq));
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "%s:%d: unknown key <%.*s>\n", path, lineno, len, name);
+            exit(1);
+        }
+        nkeys++;
+        s = end + 1;
+    }
+    return nkeys;
+}
+
+static void benchLoadScript(const char *path, struct benchScript *sc) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) die(path);
+    memset(sc, 0, sizeof(*sc));
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(sc->name, sizeof(sc->name), "%.*s", (int)strcspn(base, "."), base);
+    sc->fixture_lines = BENCH_DEFAULT_LINES;
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int lineno = 0;
+    long repeat = 1;
+    while ((len = getline(&line, &cap, fp)) != -1) {
+        lineno++;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+        if (!strncmp(line, "%fixture ", 9)) {
+            sc->fixture_lines = atoi(line + 9);
+        } else if (!strcmp(line, "%utf8")) {
+            sc->utf8 = 1;
+        } else if (!strncmp(line, "%line ", 6)) {
+            sc->line = atoi(line + 6);
+        } else if (!strncmp(line, "%repeat ", 8)) {
+            repeat = atol(line + 8);
+        } else if (!strncmp(line, "%setup ", 7)) {
+            benchParseKeys(path, lineno, line + 7, &sc->setup);
+        } else {
+            struct abuf keys = ABUF_INIT;
+            int n = benchParseKeys(path, lineno, line, &keys);
+            for (long r = 0; r < repeat; r++) abAppend(&sc->keys, keys.b, keys.len);
+            abFree(&keys);
+            sc->ops += repeat;
+            sc->nkeys += n * repeat;
+        }
+    }
+    free(line);
+    fclose(fp);
+}
+
+/*** replay ***/
+// Every key gets its own frame, as if typed one at a time
+static void benchReplay(struct abuf *keys) {
+    if (keys->len == 0) return;
+    editorFeedInput(keys->b, keys->len, -1);
+    while (editorInputPending()) {
+        editorProcessKeypress();
+        editorRefreshScreen();
+    }
+}
+
+static void benchRun(struct benchScript *sc, int first) {
+    editorOpen((char *)benchFixture(sc->fixture_lines, sc->utf8));
+    editorLoadFinish();
+    E.cy = sc->line < E.numrows ? sc->line : E.numrows - 1;
+    E.cx = 0;
+    editorInvalidateFrame();
+    editorRefreshScreen();
+    benchReplay(&sc->setup);
+
+    output_bytes = 0;
+    long long start = benchNow();
+    benchReplay(&sc->keys);
+    long long elapsed = benchNow() - start;
+
+    printf("%s\n    {\"script\": \"%s\", \"fixture_lines\": %d, \"ops\": %ld, "
+            "\"keys\": %ld, \"ns_per_op\": %.1f, \"ns_per_key\": %.1f, "
+            "\"bytes_per_op\": %.1f}",
+            first ? "" : ",", sc->name, sc->fixture_lines, sc->ops, sc->nkeys,
+            sc->ops ? (double)elapsed / sc->ops : 0.0,
+            sc->nkeys ? (double)elapsed / sc->nkeys : 0.0,
+            sc->ops ? (double)output_bytes / sc->ops : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s script.keys...\n", argv[0]);
+        return 1;
+    }
+    initEditor();
+    editorResize(BENCH_ROWS + 2, BENCH_COLS);
+    editorSetOutput(benchOutput);
+    atexit(benchRemoveFixtures);
+
+    printf("{\n  \"rows\": %d,\n  \"cols\": %d,\n  \"results\": [", BENCH_ROWS, BENCH_COLS);
+    for (int i = 1; i < argc; i++) {
+        struct benchScript sc;
+        benchLoadScript(argv[i], &sc);
+        benchRun(&sc, i == 1);
+        fflush(stdout);
+        abFree(&sc.setup);
+        abFree(&sc.keys);
+    }
+    journalShutdown();
+    printf("\n  ]\n}\n");
+    return 0;
+}
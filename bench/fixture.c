@@ -0,0 +1,77 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fixture.h"
+
+struct benchFixture {
+    int lines;
+    int utf8;
+    char path[64];
+};
+
+static struct benchFixture *fixtures = NULL;
+static int num_fixtures = 0;
+
+// Deterministic C-like source: nesting, comments, strings, numbers and
+// keywords, with a tab indented line now and then. The needle only
+// appears on the last line, so a search has to walk the whole file.
+// The utf8 flavour has accented, CJK and emoji text in strings and
+// comments, with a combining mark now and then.
+void benchWriteFixture(FILE *fp, int lines, int utf8) {
+    static const char *ascii[] = {
+        "int value_%d = compute(%d, \"string %d\");",
+        "    if (count_%d > %d) { total += %d; }",
+        "/* block comment about item %d, see %d and %d */",
+        "\tfor (int i = 0; i < %d; i++) buffer[i] = %d + %d;",
+        "    return lookup(table_%d, %d) // fallback %d",
+        "struct node_%d { int left; int right; char tag[%d]; }; // %d",
+        "",
+        "        while (queue_%d != NULL) queue_%d = next(%d);",
+    };
+    static const char *wide[] = {
+        "int valeur_%d = calculer(%d, \"chaîne numéro %d\");",
+        "    if (count_%d > %d) { total += %d; } // 合計を更新する",
+        "/* 块注释 %d，参见 %d 和 %d */",
+        "\tfor (int i = 0; i < %d; i++) buffer[i] = %d + %d; // ✅ 🚀",
+        "    return lookup(table_%d, %d) // Größe %d, naïve café",
+        "struct node_%d { int left; int right; char tag[%d]; }; // 노드 %d",
+        "",
+        "        while (queue_%d != NULL) queue_%d = next(%d); // e\xcc\x81tat",
+    };
+    const char **templates = utf8 ? wide : ascii;
+    int ntemplates = sizeof(ascii) / sizeof(ascii[0]);
+    for (int i = 0; i < lines - 1; i++) {
+        fprintf(fp, templates[i % ntemplates], i, i % 97, i * 7);
+        fputc('\n', fp);
+    }
+    fprintf(fp, "int %s = 1;\n", BENCH_NEEDLE);
+}
+
+// Path of a fixture with `lines` lines, written on first use
+const char *benchFixture(int lines, int utf8) {
+    for (int i = 0; i < num_fixtures; i++) {
+        if (fixtures[i].lines == lines && fixtures[i].utf8 == utf8) return fixtures[i].path;
+    }
+    fixtures = realloc(fixtures, sizeof(struct benchFixture) * (num_fixtures + 1));
+    struct benchFixture *f = &fixtures[num_fixtures++];
+    f->lines = lines;
+    f->utf8 = utf8;
+    strcpy(f->path, "/tmp/kilo-bench-XXXXXX.c");
+    int fd = mkstemps(f->path, 2);
+    if (fd == -1) {
+        perror("mkstemps");
+        exit(1);
+    }
+    FILE *fp = fdopen(fd, "w");
+    benchWriteFixture(fp, lines, utf8);
+    fclose(fp);
+    return f->path;
+}
+
+void benchRemoveFixtures(void) {
+    for (int i = 0; i < num_fixtures; i++) unlink(fixtures[i].path);
+}
@@ -0,0 +1,15 @@
+#ifndef FIXTURE_H_
+#define FIXTURE_H_
+
+#include <stdio.h>
+
+/* Generated fixture files shared by the benchmarks. */
+#define BENCH_NEEDLE "kilo_bench_needle"
+
+void benchWriteFixture(FILE *fp, int lines, int utf8);
+
+const char *benchFixture(int lines, int utf8);
+
+void benchRemoveFixtures(void);
+
+#endif
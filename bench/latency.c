@@ -0,0 +1,225 @@
+/* Keystroke to screen latency of the real editor.
+ *
+ * Starts kilo on a pseudo-terminal, sends one key at a time and reads the
+ * output stream until the frame that key caused has been written in full.
+ * Every frame ends by revealing the cursor again, so a key is done once
+ * "\x1b[?25h" has come through and nothing else follows within
+ * LATENCY_QUIET_MS. Latency runs from just before the key is written to
+ * the arrival of that last frame. Prints JSON with p50/p99/p999 per file
+ * and workload.
+ *
+ * usage: kilo-latency [-n keys] path/to/kilo
+ */
+#define _GNU_SOURCE
+
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fixture.h"
+
+#define LATENCY_ROWS 50
+#define LATENCY_COLS 160
+#define LATENCY_QUIET_MS 2
+#define LATENCY_TIMEOUT_MS 10000
+// Longer than the help message stays up, so its expiry redraw comes first
+#define LATENCY_WARMUP_MS 5500
+#define LATENCY_FRAME_END "\x1b[?25h"
+
+struct latencyEditor {
+    pid_t pid;
+    int fd;
+    // Tail of the previous read, in case the marker straddles two reads
+    char carry[sizeof(LATENCY_FRAME_END)];
+    int carry_len;
+};
+
+struct latencyWorkload {
+    const char *name;
+    // Bytes for key number i of the run
+    const char *(*key)(long i);
+};
+
+static const int latencyFiles[] = {1000, 200000};
+
+/*** timing ***/
+static long long latencyNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int latencyCompare(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static double latencyPercentile(long long *samples, long n, double p) {
+    if (n == 0) return 0;
+    long at = (long)(p * (n - 1) + 0.5);
+    return samples[at] / 1000.0;
+}
+
+/*** editor process ***/
+static void latencyStart(struct latencyEditor *ed, const char *kilo, const char *file) {
+    struct winsize ws;
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_row = LATENCY_ROWS;
+    ws.ws_col = LATENCY_COLS;
+    ed->carry_len = 0;
+    ed->pid = forkpty(&ed->fd, NULL, NULL, &ws);
+    if (ed->pid == -1) {
+        perror("forkpty");
+        exit(1);
+    }
+    if (ed->pid == 0) {
+        execl(kilo, kilo, file, (char *)NULL);
+        perror(kilo);
+        _exit(127);
+    }
+}
+
+static void latencyStop(struct latencyEditor *ed) {
+    kill(ed->pid, SIGKILL);
+    waitpid(ed->pid, NULL, 0);
+    close(ed->fd);
+}
+
+// Read whatever is ready within timeout_ms. Returns -1 once the editor is
+// gone, 0 if nothing came, 1 for output and 2 if that finished a frame.
+static int latencyRead(struct latencyEditor *ed, int timeout_ms) {
+    struct pollfd pfd = {ed->fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+    char buf[65536 + sizeof(ed->carry)];
+    memcpy(buf, ed->carry, ed->carry_len);
+    int n = read(ed->fd, buf + ed->carry_len, 65536);
+    if (n <= 0) return -1;
+    n += ed->carry_len;
+
+    int mlen = strlen(LATENCY_FRAME_END);
+    int done = memmem(buf, n, LATENCY_FRAME_END, mlen) != NULL;
+    ed->carry_len = n < mlen - 1 ? n : mlen - 1;
+    memcpy(ed->carry, buf + n - ed->carry_len, ed->carry_len);
+    // Don't find the same marker twice
+    if (done) ed->carry_len = 0;
+    return done ? 2 : 1;
+}
+
+// Wait for the frames caused by the last key. Returns when the last of
+// them arrived, or -1 if none came.
+static long long latencySettle(struct latencyEditor *ed) {
+    long long deadline = latencyNow() + LATENCY_TIMEOUT_MS * 1000000LL;
+    long long last = -1;
+    while (1) {
+        int wait = last == -1 ? (int)((deadline - latencyNow()) / 1000000) : LATENCY_QUIET_MS;
+        if (wait <= 0) break;
+        int r = latencyRead(ed, wait);
+        if (r == -1) break;
+        if (r == 2) last = latencyNow();
+        // Quiet long enough, so that was the last frame for this key
+        if (r == 0 && last != -1) break;
+    }
+    return last;
+}
+
+/*** workloads ***/
+static const char *latencyTyping(long i) {
+    static const char text[] = "the quick brown fox jumps over the lazy dog";
+    static char key[2];
+    long at = i % (sizeof(text));
+    if (at == sizeof(text) - 1) return "\r";
+    key[0] = text[at];
+    return key;
+}
+
+static const char *latencyScrolling(long i) {
+    // Mostly single line scrolls, with a page jump now and then
+    if (i % 20 == 19) return "\x1b[6~";
+    return "\x1b[B";
+}
+
+static const char *latencySearching(long i) {
+    static char key[2];
+    static const char query[] = BENCH_NEEDLE;
+    long at = i % (sizeof(query) + 1);
+    if (at == 0) return "\x06";
+    if (at == sizeof(query)) return "\r";
+    key[0] = query[at - 1];
+    return key;
+}
+
+static const struct latencyWorkload latencyWorkloads[] = {
+    {"typing", latencyTyping},
+    {"scrolling", latencyScrolling},
+    {"searching", latencySearching},
+};
+
+static void latencyRun(const char *kilo, int lines, const struct latencyWorkload *w,
+        long keys, int first) {
+    struct latencyEditor ed;
+    latencyStart(&ed, kilo, benchFixture(lines, 0));
+    // Swallow the first frame and the help message expiring, so neither
+    // lands inside a measurement
+    long long start = latencyNow();
+    while (latencyNow() - start < LATENCY_WARMUP_MS * 1000000LL) {
+        if (latencyRead(&ed, 100) == -1) break;
+    }
+
+    long long *samples = malloc(sizeof(long long) * keys);
+    long n = 0;
+    long lost = 0;
+    for (long i = 0; i < keys; i++) {
+        const char *key = w->key(i);
+        long long sent = latencyNow();
+        if (write(ed.fd, key, strlen(key)) == -1) break;
+        long long done = latencySettle(&ed);
+        if (done == -1) {
+            lost++;
+            continue;
+        }
+        samples[n++] = done - sent;
+    }
+    latencyStop(&ed);
+
+    qsort(samples, n, sizeof(long long), latencyCompare);
+    printf("%s\n    {\"file_lines\": %d, \"workload\": \"%s\", \"samples\": %ld, "
+            "\"lost\": %ld, \"p50_us\": %.1f, \"p99_us\": %.1f, \"p999_us\": %.1f, "
+            "\"max_us\": %.1f}",
+            first ? "" : ",", lines, w->name, n, lost,
+            latencyPercentile(samples, n, 0.50), latencyPercentile(samples, n, 0.99),
+            latencyPercentile(samples, n, 0.999), n ? samples[n - 1] / 1000.0 : 0.0);
+    fflush(stdout);
+    free(samples);
+}
+
+int main(int argc, char *argv[]) {
+    long keys = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') keys = atol(optarg);
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-n keys] path/to/kilo\n", argv[0]);
+        return 1;
+    }
+    const char *kilo = argv[optind];
+    atexit(benchRemoveFixtures);
+
+    printf("{\n  \"rows\": %d,\n  \"cols\": %d,\n  \"results\": [", LATENCY_ROWS, LATENCY_COLS);
+    int first = 1;
+    for (size_t f = 0; f < sizeof(latencyFiles) / sizeof(latencyFiles[0]); f++) {
+        for (size_t w = 0; w < sizeof(latencyWorkloads) / sizeof(latencyWorkloads[0]); w++) {
+            latencyRun(kilo, latencyFiles[f], &latencyWorkloads[w], keys, first);
+            first = 0;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
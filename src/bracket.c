@@ -0,0 +1,375 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "bracket.h"
+#include "buffer.h"
+#include "decor.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "memory.h"
+#include "syntax.h"
+#include "treap.h"
+
+// Opening brackets count one up, closing ones one down
+struct bracketSum {
+    // Depth at the end
+    int sum;
+    // Lowest depth on the way, 0 at most
+    int low;
+};
+
+struct bracketNode {
+    struct treapNode node;
+    struct bracketSum own;
+    // Of the whole subtree, in row order
+    struct bracketSum all;
+};
+
+struct bracketIndex {
+    struct treapNode *root;
+};
+
+// The pair the rows being drawn show, that of the view drawing them
+static struct bracketPair shown;
+
+/*** treap ***/
+static struct bracketNode *bracketOf(struct treapNode *n) {
+    return (struct bracketNode *)n;
+}
+
+// a followed by b
+static struct bracketSum bracketJoin(struct bracketSum a, struct bracketSum b) {
+    struct bracketSum s;
+    s.sum = a.sum + b.sum;
+    s.low = a.sum + b.low < a.low ? a.sum + b.low : a.low;
+    return s;
+}
+
+static void bracketPull(struct treapNode *n) {
+    struct bracketNode *b = bracketOf(n);
+    b->all = b->own;
+    if (n->left) b->all = bracketJoin(bracketOf(n->left)->all, b->all);
+    if (n->right) b->all = bracketJoin(b->all, bracketOf(n->right)->all);
+}
+
+static struct treapNode *bracketNew(int row, struct bracketSum own) {
+    struct bracketNode *b = memAlloc(MEM_LAYOUT, sizeof(struct bracketNode));
+    treapInit(&b->node, row);
+    b->own = b->all = own;
+    return &b->node;
+}
+
+static void bracketPullAll(struct treapNode *n) {
+    if (!n) return;
+    bracketPullAll(n->left);
+    bracketPullAll(n->right);
+    bracketPull(n);
+}
+
+/*** rows ***/
+static int bracketOpens(char c) {
+    return c == '(' || c == '[' || c == '{';
+}
+
+static int bracketCloses(char c) {
+    return c == ')' || c == ']' || c == '}';
+}
+
+// Whether render[i] is a bracket that counts, not one in a string or a
+// comment. Needs the row's hl.
+static int bracketAt(erow *row, int i) {
+    char c = row->render[i];
+    if (!bracketOpens(c) && !bracketCloses(c)) return 0;
+    if (!E.syntax) return 1;
+    return row->hl[i] != HL_STRING && row->hl[i] != HL_COMMENT && row->hl[i] != HL_MLCOMMENT;
+}
+
+// The first bracket in render from i on, end if none before it. Rows of
+// text have few, so they are skipped to with the C library rather than
+// looked at one byte at a time. Long rows render straight from chars, can
+// hold a NUL and are scanned a segment at a time, where strcspn would run
+// on to the end of the row: they go byte by byte.
+static int bracketNext(erow *row, int i, int end) {
+    if (row->nsegs) {
+        while (i < end && !bracketOpens(row->render[i]) && !bracketCloses(row->render[i])) i++;
+        return i;
+    }
+    if (i < end) i += strcspn(&row->render[i], "()[]{}");
+    return i < end ? i : end;
+}
+
+static struct bracketSum bracketScanRange(erow *row, int start, int end) {
+    struct bracketSum s = {0, 0};
+    for (int i = bracketNext(row, start, end); i < end; i = bracketNext(row, i + 1, end)) {
+        if (!bracketAt(row, i)) continue;
+        s.sum += bracketOpens(row->render[i]) ? 1 : -1;
+        if (s.sum < s.low) s.low = s.sum;
+    }
+    return s;
+}
+
+// A long row keeps a summary per segment, so an edit only rescans the
+// segments from `from` up to `to` and those not summed up yet
+static struct bracketSum bracketScanSegments(erow *row, int from, int to) {
+    struct bracketSum s = {0, 0};
+    for (int k = 0; k < row->nsegs; k++) {
+        struct rowSegment *seg = &row->segs[k];
+        if ((k >= from && k < to) || seg->bracket_low > 0) {
+            struct bracketSum own = bracketScanRange(row, seg->start, seg->start + seg->len);
+            seg->bracket_sum = own.sum;
+            seg->bracket_low = own.low;
+        }
+        s = bracketJoin(s, (struct bracketSum){seg->bracket_sum, seg->bracket_low});
+    }
+    return s;
+}
+
+static struct bracketSum bracketScan(erow *row) {
+    if (row->nsegs) return bracketScanSegments(row, 0, row->nsegs);
+    return bracketScanRange(row, 0, row->rsize);
+}
+
+// The summary of row becomes own. Rows whose brackets all pair up among
+// themselves have no node.
+static void bracketSet(int row, struct bracketSum own) {
+    struct treapNode *left, *mid, *right;
+    treapSplit(E.brackets->root, row, &left, &right, bracketPull);
+    treapSplit(right, row + 1, &mid, &right, bracketPull);
+    if (own.sum == 0 && own.low == 0) {
+        treapFree(mid);
+        mid = NULL;
+    } else {
+        if (!mid) mid = bracketNew(row, own);
+        bracketOf(mid)->own = own;
+        bracketPull(mid);
+    }
+    E.brackets->root = treapMerge(treapMerge(left, mid, bracketPull), right, bracketPull);
+}
+
+// Summed up from the row's hl, which rows without any get only for as
+// long as that takes: it is not kept for rows that are not drawn.
+static struct bracketSum bracketScanRebuilt(erow *row) {
+    int had = row->hl != NULL;
+    editorRowEnsureHl(row);
+    struct bracketSum s = bracketScan(row);
+    if (!had) editorRowDropHl(row);
+    return s;
+}
+
+// Every row summed up. Rows come in order, so each new node goes on the
+// right edge of the tree, under the last node there that outranks it:
+// linear, where one insert after the other would be O(n log n).
+static void bracketBuild(void) {
+    struct treapNode *root = NULL, **edge = NULL;
+    int depth = 0, cap = 0;
+    for (int i = 0; i < E.numrows; i++) {
+        struct bracketSum own = bracketScanRebuilt(&E.row[i]);
+        if (own.sum == 0 && own.low == 0) continue;
+        struct treapNode *n = bracketNew(i, own);
+        while (depth > 0 && edge[depth - 1]->prio < n->prio) n->left = edge[--depth];
+        if (depth > 0) edge[depth - 1]->right = n;
+        else root = n;
+        if (depth == cap) {
+            cap = cap ? cap * 2 : 64;
+            edge = realloc(edge, sizeof(struct treapNode *) * cap);
+        }
+        edge[depth++] = n;
+    }
+    free(edge);
+    bracketPullAll(root);
+    // Not before now, highlighting above would call back into it
+    E.brackets = calloc(1, sizeof(struct bracketIndex));
+    E.brackets->root = root;
+}
+
+/*** edits ***/
+// row has just been highlighted
+void bracketRowChanged(erow *row) {
+    if (!E.brackets) return;
+    bracketSet(row->idx, bracketScan(row));
+}
+
+// Segments from..to-1 of long row have just been highlighted again
+void bracketSegmentsChanged(erow *row, int from, int to) {
+    if (!E.brackets) return;
+    bracketSet(row->idx, bracketScanSegments(row, from, to));
+}
+
+// E.row[at] is new, and not highlighted yet
+void bracketInsertRow(int at) {
+    if (!E.brackets) return;
+    struct treapNode *left, *right;
+    treapSplit(E.brackets->root, at, &left, &right, bracketPull);
+    treapMove(right, 1);
+    E.brackets->root = treapMerge(left, right, bracketPull);
+}
+
+void bracketDelRow(int at) {
+    if (!E.brackets) return;
+    struct treapNode *left, *mid, *right;
+    treapSplit(E.brackets->root, at, &left, &right, bracketPull);
+    treapSplit(right, at + 1, &mid, &right, bracketPull);
+    treapFree(mid);
+    treapMove(right, -1);
+    E.brackets->root = treapMerge(left, right, bracketPull);
+}
+
+void bracketFree(void) {
+    if (!E.brackets) return;
+    treapFree(E.brackets->root);
+    free(E.brackets);
+    E.brackets = NULL;
+}
+
+/*** matching ***/
+// The first row after `row` where a depth of *depth, carried on, goes
+// below zero; *depth becomes the depth going into it. -1 if none does.
+static int bracketFindAfter(int row, int *depth) {
+    struct treapNode *left, *right, *n;
+    treapSplit(E.brackets->root, row + 1, &left, &right, bracketPull);
+    int found = -1;
+    for (n = right; n;) {
+        treapPush(n);
+        if (n->left && *depth + bracketOf(n->left)->all.low < 0) {
+            n = n->left;
+            continue;
+        }
+        if (n->left) *depth += bracketOf(n->left)->all.sum;
+        if (*depth + bracketOf(n)->own.low < 0) {
+            found = n->row;
+            break;
+        }
+        *depth += bracketOf(n)->own.sum;
+        n = n->right;
+    }
+    E.brackets->root = treapMerge(left, right, bracketPull);
+    return found;
+}
+
+// The same going back from `row`, with depth counting closing brackets up.
+// A row taken from its end dips to sum - low below where it ends.
+static int bracketFindBefore(int row, int *depth) {
+    struct treapNode *left, *right, *n;
+    treapSplit(E.brackets->root, row, &left, &right, bracketPull);
+    int found = -1;
+    for (n = left; n;) {
+        treapPush(n);
+        if (n->right && *depth < bracketOf(n->right)->all.sum - bracketOf(n->right)->all.low) {
+            n = n->right;
+            continue;
+        }
+        if (n->right) *depth -= bracketOf(n->right)->all.sum;
+        if (*depth < bracketOf(n)->own.sum - bracketOf(n)->own.low) {
+            found = n->row;
+            break;
+        }
+        *depth -= bracketOf(n)->own.sum;
+        n = n->left;
+    }
+    E.brackets->root = treapMerge(left, right, bracketPull);
+    return found;
+}
+
+// Scan row from render index `from` for where depth goes below zero,
+// forward (dir 1) or back (-1). -1 if it does not.
+static int bracketScanRow(erow *row, int from, int dir, int *depth) {
+    if (dir > 0) from = bracketNext(row, from, row->rsize);
+    for (int i = from; i >= 0 && i < row->rsize;
+            i = dir > 0 ? bracketNext(row, i + 1, row->rsize) : i - 1) {
+        if (!bracketAt(row, i)) continue;
+        if (bracketOpens(row->render[i]) == (dir > 0)) (*depth)++;
+        else if (--(*depth) < 0) return i;
+    }
+    return -1;
+}
+
+// The bracket matching the one at chars cx of row, in *mrow and *mcx.
+// Returns 0 if there is no bracket there, or it has no match of its kind.
+int bracketMatch(int row, int cx, int *mrow, int *mcx) {
+    if (row >= E.numrows || cx >= E.row[row].size) return 0;
+    char c = E.row[row].chars[cx];
+    if (!bracketOpens(c) && !bracketCloses(c)) return 0;
+    if (!E.brackets) bracketBuild();
+
+    erow *r = &E.row[row];
+    editorRowEnsureHl(r);
+    int start, ri = editorRxToRender(r, editorCxToRx(r, cx) - E.lineno_offset, &start);
+    if (!bracketAt(r, ri)) return 0;
+    int dir = bracketOpens(c) ? 1 : -1, depth = 0;
+    int at = bracketScanRow(r, ri + dir, dir, &depth);
+    int to = row;
+    if (at == -1) {
+        to = dir > 0 ? bracketFindAfter(row, &depth) : bracketFindBefore(row, &depth);
+        if (to == -1) return 0;
+        r = &E.row[to];
+        // The match can be anywhere in the file, not just on screen
+        int had = r->hl != NULL;
+        editorRowEnsureHl(r);
+        at = bracketScanRow(r, dir > 0 ? 0 : r->rsize - 1, dir, &depth);
+        if (!had) editorRowDropHl(r);
+        if (at == -1) return 0;
+    }
+    char m = r->render[at];
+    if (!((c == '(' && m == ')') || (c == '[' && m == ']') || (c == '{' && m == '}') ||
+            (c == ')' && m == '(') || (c == ']' && m == '[') || (c == '}' && m == '{'))) {
+        return 0;
+    }
+    *mrow = to;
+    *mcx = editorRenderToCx(r, at);
+    return 1;
+}
+
+// Work out p again for the cursor in E, which is the view's, if that or
+// the text has moved since. Rows drawn next show p. Returns whether what
+// they show is different from last time.
+int bracketHighlight(struct bracketPair *p) {
+    struct bracketPair was = *p;
+    if (E.cy >= E.numrows || E.cx >= E.row[E.cy].size ||
+            (!bracketOpens(E.row[E.cy].chars[E.cx]) && !bracketCloses(E.row[E.cy].chars[E.cx]))) {
+        p->found = 0;
+        p->version = 0;
+    } else if (p->buffer != bufferId() || p->row != E.cy || p->cx != E.cx ||
+            p->version != E.version) {
+        p->found = bracketMatch(E.cy, E.cx, &p->mrow, &p->mcx);
+        p->buffer = bufferId();
+        p->row = E.cy;
+        p->cx = E.cx;
+        // Matching can highlight rows, so after it
+        p->version = E.version;
+    }
+    shown = *p;
+    if (!p->found) return was.found;
+    return !was.found || was.buffer != p->buffer || was.row != p->row || was.cx != p->cx ||
+            was.mrow != p->mrow || was.mcx != p->mcx;
+}
+
+// The bracket and its match in row filerow, as decorSpans
+int bracketRowSpans(erow *row, int filerow, struct decorSpan *spans, int max) {
+    int n = 0;
+    if (!shown.found) return 0;
+    if (filerow == shown.row && n < max && shown.cx < row->size) {
+        spans[n].kind = DECOR_BRACKET;
+        spans[n].start = editorCxToRx(row, shown.cx) - E.lineno_offset;
+        spans[n].end = editorCxToRx(row, shown.cx + 1) - E.lineno_offset;
+        n++;
+    }
+    if (filerow == shown.mrow && n < max && shown.mcx < row->size) {
+        spans[n].kind = DECOR_BRACKET;
+        spans[n].start = editorCxToRx(row, shown.mcx) - E.lineno_offset;
+        spans[n].end = editorCxToRx(row, shown.mcx + 1) - E.lineno_offset;
+        n++;
+    }
+    return n;
+}
+
+void bracketJump(void) {
+    int row, cx;
+    if (!bracketMatch(E.cy, E.cx, &row, &cx)) {
+        editorSetStatusMessage("No matching bracket");
+        return;
+    }
+    E.cy = row;
+    E.cx = cx;
+    E.cursor_pos = cx;
+}
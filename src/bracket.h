@@ -0,0 +1,52 @@
+#ifndef BRACKET_H_
+#define BRACKET_H_
+
+#include "terminal.h"
+#include "decor.h"
+
+/* Bracket matching.
+ *
+ * Every row with brackets that do not pair up among themselves keeps a
+ * summary of them: how deep it leaves the nesting, and how far below its
+ * start it dips on the way. Brackets in strings and comments, going by
+ * the highlighting, do not count. The summaries sit in a treap ordered
+ * by row, each node also summing up its subtree, so the row a bracket's
+ * match is on is found in one walk down, O(log n) however far away it
+ * is. Highlighting a row updates its summary along one path of the tree;
+ * rows coming or going shift the rows after them, as for folds. Long
+ * rows keep a summary per segment too, and an edit rescans only the
+ * segments it highlighted again.
+ *
+ * The bracket at the cursor and its match are each view's own, drawn
+ * over the rows the way decorations are but kept out of the buffer's.
+ */
+// The bracket at a view's cursor and its match, as last worked out
+struct bracketPair {
+    int buffer;
+    int row;
+    int cx;
+    unsigned long version;
+    int found;
+    int mrow;
+    int mcx;
+};
+
+int bracketMatch(int row, int cx, int *mrow, int *mcx);
+
+int bracketHighlight(struct bracketPair *p);
+
+int bracketRowSpans(erow *row, int filerow, struct decorSpan *spans, int max);
+
+void bracketJump(void);
+
+void bracketRowChanged(erow *row);
+
+void bracketSegmentsChanged(erow *row, int from, int to);
+
+void bracketInsertRow(int at);
+
+void bracketDelRow(int at);
+
+void bracketFree(void);
+
+#endif
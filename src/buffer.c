@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "bracket.h"
+#include "buffer.h"
+#include "decor.h"
+#include "draw.h"
+#include "editor.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "fileio.h"
+#include "follow.h"
+#include "journal.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "memory.h"
+#include "reload.h"
+#include "rowalloc.h"
+#include "snapshot.h"
+#include "view.h"
+#include "wrap.h"
+
+struct editorBuffer {
+    int id;
+    // Stale while the buffer is current, E has it then
+    struct editorConfig state;
+    // Highlighting and snapshot dropped since it was last on screen
+    int compacted;
+};
+
+static struct editorBuffer *buffers = NULL;
+static int nbuffers = 0;
+static int current = 0;
+static int next_id = 0;
+static int compact_timer = -1;
+
+/*** switching ***/
+// Load buffer at into E, keeping what belongs to the editor as a whole
+static void bufferLoad(int at) {
+    struct editorConfig ui = E;
+    E = buffers[at].state;
+    E.screenrows = ui.screenrows;
+    E.screencols = ui.screencols;
+    E.copy_buffer = ui.copy_buffer;
+    E.copy_buffer_len = ui.copy_buffer_len;
+    memcpy(E.statusMessage, ui.statusMessage, sizeof(E.statusMessage));
+    E.statusmsg_time = ui.statusmsg_time;
+    E.prev_char = ui.prev_char;
+    E.orig_termios = ui.orig_termios;
+    current = at;
+}
+
+static void bufferSwap(int at) {
+    buffers[current].state = E;
+    bufferLoad(at);
+}
+
+// Hand back what a background buffer can rebuild when it is shown again.
+// Buffers in another view are drawn every frame and keep theirs.
+static void bufferCompactTimer(void *arg) {
+    (void)arg;
+    int shown = current;
+    for (int i = 0; i < nbuffers; i++) {
+        if (i == shown || buffers[i].compacted || viewShowsBuffer(buffers[i].id)) continue;
+        bufferSwap(i);
+        for (int r = 0; r < E.numrows; r++) E.row[r].hl = NULL;
+        memArenaReset(E.hl_arena);
+        snapshotReset();
+        wrapFree();
+        lineIndexFree();
+        bracketFree();
+        buffers[i].compacted = 1;
+    }
+    if (current != shown) bufferSwap(shown);
+}
+
+// The buffer E holds becomes the first one the first time it's needed
+static void bufferSetup(void) {
+    if (nbuffers) return;
+    buffers = calloc(1, sizeof(struct editorBuffer));
+    buffers[0].id = next_id++;
+    nbuffers = 1;
+    current = 0;
+    compact_timer = eventLoopAddTimer(bufferCompactTimer, NULL);
+}
+
+int bufferCount(void) {
+    return nbuffers ? nbuffers : 1;
+}
+
+int bufferCurrent(void) {
+    return current;
+}
+
+// Stays the same while the buffer is open, unlike its position
+int bufferId(void) {
+    return nbuffers ? buffers[current].id : 0;
+}
+
+void bufferSwitch(int at) {
+    bufferSetup();
+    if (at < 0 || at >= nbuffers || at == current) return;
+    bufferSwap(at);
+    buffers[at].compacted = 0;
+    eventLoopArmTimer(compact_timer, KILO_BUFFER_COMPACT, 0);
+    eventLoopRequestRedraw();
+}
+
+/*** opening and closing ***/
+int bufferFindId(int id) {
+    if (!nbuffers) return id == 0 ? 0 : -1;
+    for (int i = 0; i < nbuffers; i++) {
+        if (buffers[i].id == id) return i;
+    }
+    return -1;
+}
+
+int bufferFind(const char *filename) {
+    for (int i = 0; i < bufferCount(); i++) {
+        const char *name = i == current ? E.filename : buffers[i].state.filename;
+        if (name && !strcmp(name, filename)) return i;
+    }
+    return -1;
+}
+
+// Show filename, opening it in a new buffer unless it is open already.
+// Returns the buffer it is in.
+int bufferOpen(const char *filename) {
+    bufferSetup();
+    int at = bufferFind(filename);
+    if (at != -1) {
+        bufferSwitch(at);
+        return at;
+    }
+    // An empty scratch buffer is as good as a new one
+    if (E.filename || E.dirty || E.numrows) {
+        buffers = realloc(buffers, sizeof(struct editorBuffer) * (nbuffers + 1));
+        struct editorConfig shown = E;
+        initEditor();
+        buffers[nbuffers].id = next_id++;
+        buffers[nbuffers].state = E;
+        buffers[nbuffers].compacted = 0;
+        E = shown;
+        bufferSwitch(nbuffers++);
+    }
+    editorOpen((char *)filename);
+    return current;
+}
+
+// Close the current buffer and show the next one. Unsaved changes are
+// dropped, along with their recovery files. -1 for the last buffer.
+int bufferClose(void) {
+    if (bufferCount() == 1) return -1;
+    editorLoadCancel();
+    editorFollowStop();
+    editorWatchStop();
+    editorSavedInstall(NULL);
+    decorFree();
+    journalClose(E.journal);
+    E.journal = NULL;
+    editorFreeRows();
+    rowArenaFree(E.arena);
+    rowArenaFree(E.hl_arena);
+    free(E.filename);
+
+    int closed = current;
+    memmove(&buffers[closed], &buffers[closed + 1],
+            sizeof(struct editorBuffer) * (nbuffers - closed - 1));
+    nbuffers--;
+    bufferLoad(closed < nbuffers ? closed : nbuffers - 1);
+    buffers[current].compacted = 0;
+    eventLoopRequestRedraw();
+    return 0;
+}
+
+int bufferAnyDirty(void) {
+    for (int i = 0; i < bufferCount(); i++) {
+        if (i == current ? E.dirty : buffers[i].state.dirty) return 1;
+    }
+    return 0;
+}
+
+// Stop journaling the background buffers, journalShutdown does E's
+void bufferShutdown(void) {
+    for (int i = 0; i < nbuffers; i++) {
+        if (i == current) continue;
+        journalClose(buffers[i].state.journal);
+        buffers[i].state.journal = NULL;
+    }
+}
+
+void bufferGetInfo(int at, struct bufferInfo *info) {
+    struct editorConfig *st = at == current ? &E : &buffers[at].state;
+    struct rowArenaStats rows, hl;
+    rowArenaGetStats(st->arena, &rows);
+    rowArenaGetStats(st->hl_arena, &hl);
+    info->id = nbuffers ? buffers[at].id : 0;
+    info->filename = st->filename;
+    info->numrows = st->numrows;
+    info->dirty = st->dirty;
+    info->current = at == current;
+    info->bytes = sizeof(erow) * st->rowcap + rows.live_bytes + hl.live_bytes;
+    if (st->saved) info->bytes += sizeof(uint64_t) * st->saved->cap;
+}
+
+/*** callbacks ***/
+// Make the buffer whose E field at offset field points at owner current.
+// Returns the buffer to give to bufferLeave, or -1 if no buffer has it.
+int bufferEnter(size_t field, const void *owner) {
+    if (*(void **)((char *)&E + field) == owner) return current;
+    for (int i = 0; i < nbuffers; i++) {
+        if (i == current || *(void **)((char *)&buffers[i].state + field) != owner) continue;
+        int prev = current;
+        bufferSwap(i);
+        return prev;
+    }
+    return -1;
+}
+
+int bufferEnterId(int id) {
+    if (!nbuffers) return id == 0 ? current : -1;
+    for (int i = 0; i < nbuffers; i++) {
+        if (buffers[i].id != id) continue;
+        int prev = current;
+        if (i != current) bufferSwap(i);
+        return prev;
+    }
+    return -1;
+}
+
+void bufferLeave(int prev) {
+    if (prev < 0 || prev == current) return;
+    // Whatever the callback built for a background buffer can go again.
+    // One in another view goes once switching away from it hides it.
+    buffers[current].compacted = 0;
+    if (!viewShowsBuffer(buffers[current].id)) eventLoopArmTimer(compact_timer, KILO_BUFFER_COMPACT, 0);
+    bufferSwap(prev);
+}
@@ -0,0 +1,58 @@
+#ifndef BUFFER_H_
+#define BUFFER_H_
+
+#include <stddef.h>
+
+/* Several open files.
+ *
+ * E is always the buffer on screen. Every other buffer waits in its own
+ * copy of struct editorConfig, and switching swaps the two, which costs
+ * the same however big the files are. The terminal, the clipboard and the
+ * message bar belong to the editor rather than to a buffer and stay put.
+ * Once a buffer has been in the background, in no view, for
+ * KILO_BUFFER_COMPACT ms it gives back its highlighting and its snapshot,
+ * both rebuilt on demand.
+ *
+ * Loaders, journals, follow mode and the file watch keep running for
+ * background buffers. Their callbacks make their own buffer current with
+ * bufferEnter, find it by the pointer E holds for them, and put the
+ * previous one back with bufferLeave.
+ */
+struct bufferInfo {
+    int id;
+    const char *filename;
+    int numrows;
+    int dirty;
+    int current;
+    size_t bytes;
+};
+
+int bufferCount(void);
+
+int bufferCurrent(void);
+
+int bufferId(void);
+
+int bufferFindId(int id);
+
+int bufferFind(const char *filename);
+
+int bufferOpen(const char *filename);
+
+void bufferSwitch(int at);
+
+int bufferClose(void);
+
+int bufferAnyDirty(void);
+
+void bufferShutdown(void);
+
+void bufferGetInfo(int at, struct bufferInfo *info);
+
+int bufferEnter(size_t field, const void *owner);
+
+int bufferEnterId(int id);
+
+void bufferLeave(int prev);
+
+#endif
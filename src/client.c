@@ -0,0 +1,94 @@
+#define _DEFAULT_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "client.h"
+#include "draw.h"
+#include "editor.h"
+#include "eventloop.h"
+#include "server.h"
+
+static int daemon_fd = -1;
+static struct msgReader from_daemon;
+
+/*** client ***/
+// The daemon is gone or let us go: give the terminal back
+static void clientExit(void) {
+    editorWrite("\x1b[2J", 4);
+    editorWrite("\x1b[H", 3);
+    exit(0);
+}
+
+static void clientSize(struct abuf *ab) {
+    int rows, cols;
+    char size[32];
+    if (getWindowSize(&rows, &cols) == -1) die("getWindowSize");
+    abAppend(ab, size, snprintf(size, sizeof(size), "%d %d", rows, cols));
+}
+
+static void clientResize(int signo) {
+    (void)signo;
+    struct abuf ab = ABUF_INIT;
+    clientSize(&ab);
+    abAppend(&ab, "", 1);
+    if (msgSend(daemon_fd, MSG_RESIZE, ab.b, ab.len) == -1) clientExit();
+    abFree(&ab);
+}
+
+static void clientTerminalInput(int fd, void *arg) {
+    (void)arg;
+    char buf[4096];
+    int n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        if (msgSend(daemon_fd, MSG_INPUT, buf, n) == -1) clientExit();
+    }
+}
+
+static void clientDaemonOutput(int fd, void *arg) {
+    (void)arg;
+    int open = msgFill(fd, &from_daemon);
+    struct msg m;
+    int next;
+    while ((next = msgNext(&from_daemon, &m)) > 0) {
+        if (m.type == MSG_OUTPUT) editorWrite(m.payload, m.len);
+    }
+    if (open <= 0 || next == -1) clientExit();
+}
+
+// Attach the terminal to the daemon on fd and show files there, following
+// the first one if follow is set. Never returns.
+void clientRun(int fd, int follow, int nfiles, char **files) {
+    daemon_fd = fd;
+    struct abuf hello = ABUF_INIT;
+    char flag[8];
+    clientSize(&hello);
+    abAppend(&hello, flag, snprintf(flag, sizeof(flag), " %d", follow) + 1);
+    // The daemon has a working directory of its own
+    for (int i = 0; i < nfiles; i++) {
+        char *path = realpath(files[i], NULL);
+        if (!path && files[i][0] != '/') {
+            char *cwd = getcwd(NULL, 0);
+            if (cwd) {
+                abAppend(&hello, cwd, strlen(cwd));
+                abAppend(&hello, "/", 1);
+            }
+            free(cwd);
+        }
+        const char *name = path ? path : files[i];
+        abAppend(&hello, name, strlen(name) + 1);
+        free(path);
+    }
+    if (msgSend(fd, MSG_HELLO, hello.b, hello.len) == -1) die("send");
+    abFree(&hello);
+
+    enableRawMode();
+    eventLoopAddFd(STDIN_FILENO, clientTerminalInput, NULL);
+    eventLoopAddFd(fd, clientDaemonOutput, NULL);
+    eventLoopAddSignal(SIGWINCH, clientResize);
+    while (1) eventLoopWait(-1);
+}
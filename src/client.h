@@ -0,0 +1,13 @@
+#ifndef CLIENT_H_
+#define CLIENT_H_
+
+/* Thin client for the resident daemon.
+ *
+ * kilo -c puts the terminal in raw mode and hands it to the daemon: keys
+ * go over the socket as they are read, frames come back and go straight
+ * to the terminal, and SIGWINCH becomes a resize message. Nothing is
+ * loaded or drawn here. The client exits once the daemon lets it go.
+ */
+void clientRun(int fd, int follow, int nfiles, char **files);
+
+#endif
@@ -0,0 +1,336 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "buffer.h"
+#include "command.h"
+#include "draw.h"
+#include "eventloop.h"
+#include "fold.h"
+#include "follow.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "memory.h"
+#include "profile.h"
+#include "reload.h"
+#include "rowalloc.h"
+#include "userinput.h"
+#include "view.h"
+#include "wrap.h"
+
+/*** commands ***/
+static void cmdAllocStats(char *args) {
+    (void)args;
+    struct rowArenaStats st, hl;
+    rowArenaGetStats(E.arena, &st);
+    rowArenaGetStats(E.hl_arena, &hl);
+    st.live_bytes += hl.live_bytes;
+    st.reserved_bytes += hl.reserved_bytes;
+    st.free_bytes += hl.free_bytes;
+    st.slabs += hl.slabs;
+    st.large += hl.large;
+    st.fragmentation = st.reserved_bytes ? (int)((st.reserved_bytes - st.live_bytes) *
+            100 / st.reserved_bytes) : 0;
+    char live[16], reserved[16], freed[16];
+    editorFormatBytes(live, sizeof(live), st.live_bytes);
+    editorFormatBytes(reserved, sizeof(reserved), st.reserved_bytes);
+    editorFormatBytes(freed, sizeof(freed), st.free_bytes);
+    editorSetStatusMessage("rows: %s live, %s reserved, %s free, %d%% frag, "
+            "%ld slabs, %ld large", live, reserved, freed, st.fragmentation,
+            st.slabs, st.large);
+}
+
+// profile [refresh|syntax|update-row|find|open|save]
+static void cmdProfile(char *args) {
+    char summary[160];
+    if (!profileSummary(*args ? args : "refresh", summary, sizeof(summary))) {
+        editorSetStatusMessage("Unknown probe: %s", args);
+        return;
+    }
+    editorSetStatusMessage("%s", summary);
+}
+
+// mem                  bytes per subsystem and the budget
+// mem budget <size|off>
+static void cmdMem(char *args) {
+    char total[16], budget[16];
+    if (!strncmp(args, "budget", 6)) {
+        char *value = args + 6;
+        while (*value == ' ') value++;
+        long long bytes = !*value || !strcmp(value, "off") ? 0 : memParseSize(value);
+        if (bytes < 0) {
+            editorSetStatusMessage("Bad size: %s", value);
+            return;
+        }
+        memSetBudget(bytes);
+        editorFormatBytes(budget, sizeof(budget), bytes);
+        editorSetStatusMessage(bytes ? "Memory budget: %s" : "No memory budget", budget);
+        return;
+    }
+
+    char msg[160];
+    int len = 0;
+    for (int t = 0; t < MEM_NUM_TAGS; t++) {
+        if (memTagBytes(t) == 0) continue;
+        char bytes[16];
+        editorFormatBytes(bytes, sizeof(bytes), memTagBytes(t));
+        len += snprintf(msg + len, sizeof(msg) - len, "%s %s ", memTagName(t), bytes);
+    }
+    editorFormatBytes(total, sizeof(total), memTotalBytes());
+    editorFormatBytes(budget, sizeof(budget), memBudget());
+    if (memBudget()) editorSetStatusMessage("%s| %s of %s", msg, total, budget);
+    else editorSetStatusMessage("%s| %s, no budget", msg, total);
+}
+
+// follow [off]
+static void cmdFollow(char *args) {
+    if (!strcmp(args, "off")) {
+        editorFollowStop();
+        editorSetStatusMessage("Stopped following");
+        return;
+    }
+    if (editorFollowStart() == -1) {
+        editorSetStatusMessage(E.filename ? "Can't follow %s: %s" : "No file to follow",
+                E.filename, strerror(errno));
+        return;
+    }
+    editorSetStatusMessage("Following %s", E.filename);
+}
+
+static void cmdReload(char *args) {
+    (void)args;
+    if (editorReload() == 0) editorSetStatusMessage("%s is up to date", E.filename);
+}
+
+// open <file>          in a buffer of its own
+static void cmdOpen(char *args) {
+    if (!*args) {
+        editorSetStatusMessage("Usage: open <file>");
+        return;
+    }
+    bufferOpen(args);
+}
+
+// buffers              number, name and memory of each open buffer
+static void cmdBuffers(char *args) {
+    (void)args;
+    char msg[160];
+    int len = 0;
+    for (int i = 0; i < bufferCount() && len < (int)sizeof(msg); i++) {
+        struct bufferInfo info;
+        char bytes[16];
+        bufferGetInfo(i, &info);
+        editorFormatBytes(bytes, sizeof(bytes), info.bytes);
+        len += snprintf(msg + len, sizeof(msg) - len, "%s%d:%.20s%s %s ",
+                info.current ? "*" : "", i + 1, info.filename ? info.filename : "[No Name]",
+                info.dirty ? "+" : "", bytes);
+    }
+    editorSetStatusMessage("%s", msg);
+}
+
+// buffer <n|next|prev>
+static void cmdBuffer(char *args) {
+    int at;
+    if (!strcmp(args, "next")) at = (bufferCurrent() + 1) % bufferCount();
+    else if (!strcmp(args, "prev")) at = (bufferCurrent() + bufferCount() - 1) % bufferCount();
+    else at = atoi(args) - 1;
+    if (at < 0 || at >= bufferCount()) {
+        editorSetStatusMessage("No buffer %s", args);
+        return;
+    }
+    bufferSwitch(at);
+}
+
+// close                the current buffer, unless it has unsaved changes
+// close!               even then
+static void cmdClose(char *args) {
+    (void)args;
+    if (E.dirty) {
+        editorSetStatusMessage("%s has unsaved changes, save it or use close!",
+                E.filename ? E.filename : "[No Name]");
+        return;
+    }
+    if (bufferClose() == -1) editorSetStatusMessage("Last buffer, use Ctrl-Q to quit");
+}
+
+static void cmdCloseForce(char *args) {
+    (void)args;
+    if (bufferClose() == -1) editorSetStatusMessage("Last buffer, use Ctrl-Q to quit");
+}
+
+// fold                 close the block at the cursor, by its braces or else
+//                      its indentation, or open it again
+// unfold               open every fold
+static void cmdFold(char *args) {
+    (void)args;
+    if (foldEnd(E.cy) > E.cy) {
+        foldOpen(E.cy);
+        return;
+    }
+    int start = foldClose(E.cy);
+    if (start == -1) {
+        editorSetStatusMessage("Nothing to fold here");
+        return;
+    }
+    if (start != E.cy) {
+        E.cy = start;
+        E.cx = 0;
+        E.cursor_pos = 0;
+    }
+}
+
+static void cmdUnfold(char *args) {
+    (void)args;
+    foldOpenAll();
+}
+
+// goto <line>          the start of a line
+// goto-byte <offset>   the byte at an offset into the file, from 0
+static void cmdJump(int row, int col) {
+    if (row >= E.numrows) row = E.numrows > 0 ? E.numrows - 1 : 0;
+    if (row < 0) row = 0;
+    // Not in the middle of a character
+    while (row < E.numrows && col > 0 && (E.row[row].chars[col] & 0xc0) == 0x80) col--;
+    E.cy = row;
+    E.cx = col;
+    E.cursor_pos = col;
+    // Scrolls it to the top, as a search match
+    E.rowoff = E.numrows;
+}
+
+static void cmdGoto(char *args) {
+    char *end;
+    long line = strtol(args, &end, 10);
+    if (end == args || *end || line < 1) {
+        editorSetStatusMessage("Usage: goto <line>");
+        return;
+    }
+    if (line > INT_MAX) line = INT_MAX;
+    // It may still be on its way from disk
+    editorLoadWaitRow(line - 1);
+    cmdJump(line - 1, 0);
+}
+
+static void cmdGotoByte(char *args) {
+    char *end;
+    long long offset = strtoll(args, &end, 0);
+    if (end == args || *end || offset < 0) {
+        editorSetStatusMessage("Usage: goto-byte <offset>");
+        return;
+    }
+    // The rows it is in may still be on their way from disk
+    while (E.loader && lineIndexSize() <= offset) eventLoopWait(-1);
+    int col;
+    int row = lineIndexRowAt(offset, &col);
+    cmdJump(row, col);
+}
+
+// split                the view in two, one above the other
+// vsplit               side by side
+static void cmdSplit(char *args) {
+    (void)args;
+    if (viewSplit(0) == -1) editorSetStatusMessage("Too small to split");
+}
+
+static void cmdVsplit(char *args) {
+    (void)args;
+    if (viewSplit(1) == -1) editorSetStatusMessage("Too small to split");
+}
+
+// unsplit              close the current view, its buffer stays open
+static void cmdUnsplit(char *args) {
+    (void)args;
+    if (viewClose() == -1) editorSetStatusMessage("Last view");
+}
+
+// shutdown             quit, the daemon too, unless a buffer has unsaved changes
+// shutdown!            even then
+static void cmdShutdown(char *args) {
+    (void)args;
+    if (bufferAnyDirty()) {
+        editorSetStatusMessage("Unsaved changes, save them or use shutdown!");
+        return;
+    }
+    editorQuit();
+}
+
+static void cmdShutdownForce(char *args) {
+    (void)args;
+    editorQuit();
+}
+
+// wrap [on|off]        fold long rows onto the lines below, in this view
+static void cmdWrap(char *args) {
+    if (!*args) wrapSet(!E.wrap);
+    else if (!strcmp(args, "on")) wrapSet(1);
+    else if (!strcmp(args, "off")) wrapSet(0);
+    else editorSetStatusMessage("Usage: wrap [on|off]");
+}
+
+static struct editorCommand commands[] = {
+    {"alloc-stats", cmdAllocStats},
+    {"buffer", cmdBuffer},
+    {"buffers", cmdBuffers},
+    {"close", cmdClose},
+    {"close!", cmdCloseForce},
+    {"fold", cmdFold},
+    {"follow", cmdFollow},
+    {"goto", cmdGoto},
+    {"goto-byte", cmdGotoByte},
+    {"mem", cmdMem},
+    {"open", cmdOpen},
+    {"profile", cmdProfile},
+    {"reload", cmdReload},
+    {"shutdown", cmdShutdown},
+    {"shutdown!", cmdShutdownForce},
+    {"split", cmdSplit},
+    {"unfold", cmdUnfold},
+    {"unsplit", cmdUnsplit},
+    {"vsplit", cmdVsplit},
+    {"wrap", cmdWrap},
+};
+
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+/*** dispatch ***/
+void editorFormatBytes(char *buf, int buflen, long long bytes) {
+    const char *units[] = {"B", "K", "M", "G", "T"};
+    double value = bytes;
+    int unit = 0;
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    if (unit == 0) snprintf(buf, buflen, "%lld%s", bytes, units[unit]);
+    else snprintf(buf, buflen, "%.1f%s", value, units[unit]);
+}
+
+void editorRunCommand(char *line) {
+    while (*line == ' ') line++;
+    char *args = strchr(line, ' ');
+    int namelen = args ? args - line : (int)strlen(line);
+    if (args) {
+        while (*args == ' ') args++;
+    } else {
+        args = line + namelen;
+    }
+
+    for (unsigned int i = 0; i < NUM_COMMANDS; i++) {
+        if ((int)strlen(commands[i].name) == namelen &&
+                !strncmp(commands[i].name, line, namelen)) {
+            commands[i].run(args);
+            return;
+        }
+    }
+    editorSetStatusMessage("Unknown command: %.*s", namelen, line);
+}
+
+void editorCommandPrompt(void) {
+    char *line = editorPrompt("Command: %s (ESC to cancel)", NULL);
+    if (line == NULL) return;
+    editorRunCommand(line);
+    free(line);
+}
@@ -0,0 +1,15 @@
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+struct editorCommand {
+    char *name;
+    void (*run)(char *args);
+};
+
+void editorFormatBytes(char *buf, int buflen, long long bytes);
+
+void editorRunCommand(char *line);
+
+void editorCommandPrompt(void);
+
+#endif
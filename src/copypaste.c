@@ -3,6 +3,8 @@
 #include "terminal.h"
 #include "draw.h"
 #include "editor_ops.h"
+#include "memory.h"
+#include "userinput.h"
 
 void copy(void) {
     int move;
@@ -33,14 +35,15 @@ void copy(void) {
         move = 1;
     }
 
-    E.copy_buffer = malloc(2);
+    memFree(MEM_CLIPBOARD, E.copy_buffer);
+    E.copy_buffer = memAlloc(MEM_CLIPBOARD, 2);
     E.copy_buffer_len = 1;
 
     int idx = 0;
     while(move && !(x == x_end && y == y_end)) {
         if (idx >= E.copy_buffer_len) {
             E.copy_buffer_len *= 2;
-            E.copy_buffer = realloc(E.copy_buffer, E.copy_buffer_len + 1);
+            E.copy_buffer = memRealloc(MEM_CLIPBOARD, E.copy_buffer, E.copy_buffer_len + 1);
         }
         if (x >= E.row[y].size && y != y_end) {
             E.copy_buffer[idx] = '\n';
@@ -59,6 +62,7 @@ void copy(void) {
     editorSetStatusMessage("%d characters copied", E.copy_buffer_len);
     E.select_start_x = E.select_end_x;
     E.select_start_y = E.select_end_y;
+    editorUpdateSelection();
 }
 
 void paste(void) {
@@ -0,0 +1,71 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "terminal.h"
+#include "decor.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+
+struct decorSet {
+    struct decoration *d;
+    int n;
+    int cap;
+};
+
+void decorAdd(enum decorKind kind, int y0, int x0, int y1, int x1) {
+    if (!E.decor) E.decor = calloc(1, sizeof(struct decorSet));
+    struct decorSet *s = E.decor;
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 8;
+        s->d = realloc(s->d, sizeof(struct decoration) * s->cap);
+    }
+    s->d[s->n++] = (struct decoration){kind, y0, x0, y1, x1};
+    E.version++;
+    eventLoopRequestRedraw();
+}
+
+void decorClear(enum decorKind kind) {
+    struct decorSet *s = E.decor;
+    if (!s) return;
+    int kept = 0;
+    for (int i = 0; i < s->n; i++) {
+        if (s->d[i].kind != kind) s->d[kept++] = s->d[i];
+    }
+    if (kept != s->n) {
+        E.version++;
+        eventLoopRequestRedraw();
+    }
+    s->n = kept;
+}
+
+void decorFree(void) {
+    struct decorSet *s = E.decor;
+    if (!s) return;
+    E.decor = NULL;
+    E.version++;
+    free(s->d);
+    free(s);
+}
+
+// The parts of row filerow that are decorated. Returns how many spans
+// were stored, later decorations after earlier ones.
+int decorRowSpans(erow *row, int filerow, struct decorSpan *spans, int max) {
+    struct decorSet *s = E.decor;
+    if (!s) return 0;
+    int n = 0;
+    for (int i = 0; i < s->n && n < max; i++) {
+        struct decoration *d = &s->d[i];
+        if (filerow < d->y0 || filerow > d->y1) continue;
+        int start = filerow == d->y0 ? d->x0 : 0;
+        int end = filerow == d->y1 ? d->x1 : INT_MAX;
+        if (start > row->size) start = row->size;
+        if (end > row->size) end = row->size;
+        if (start >= end) continue;
+        // editorCxToRx counts the line number gutter, render columns don't
+        spans[n].kind = d->kind;
+        spans[n].start = editorCxToRx(row, start) - E.lineno_offset;
+        spans[n].end = editorCxToRx(row, end) - E.lineno_offset;
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,46 @@
+#ifndef DECOR_H_
+#define DECOR_H_
+
+#include "terminal.h"
+
+/* Range decorations drawn over the syntax highlighting.
+ *
+ * Search matches and the selection live here instead of in row->hl, so
+ * adding, moving or clearing one costs O(decorations) and never touches
+ * the rows. A decoration covers chars from (y0, x0) up to but not
+ * including (y1, x1); editorDrawRow asks for the spans of each visible
+ * row and lays them over hl as it draws.
+ */
+enum decorKind {
+    DECOR_NONE = 0,
+    DECOR_MATCH,
+    DECOR_SELECT,
+    DECOR_BRACKET,
+};
+
+struct decoration {
+    enum decorKind kind;
+    int y0;
+    int x0;
+    int y1;
+    int x1;
+};
+
+// One decoration clipped to a row, in render columns
+struct decorSpan {
+    enum decorKind kind;
+    int start;
+    int end;
+};
+
+struct decorSet;
+
+void decorAdd(enum decorKind kind, int y0, int x0, int y1, int x1);
+
+void decorClear(enum decorKind kind);
+
+void decorFree(void);
+
+int decorRowSpans(erow *row, int filerow, struct decorSpan *spans, int max);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+
+/*** hashing ***/
+uint64_t diffHash(const char *s, size_t len) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, s, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+        s += 8;
+        len -= 8;
+    }
+    uint64_t w = 0;
+    memcpy(&w, s, len);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+/*** hunks ***/
+struct diffOut {
+    struct diffHunk *hunks;
+    int count;
+    int cap;
+};
+
+// Record that a[x] was deleted (dx) or b[y] inserted (dy) at (x, y),
+// growing the last hunk when the edit continues it
+static void diffEdit(struct diffOut *out, int x, int y, int dx, int dy) {
+    struct diffHunk *last = out->count ? &out->hunks[out->count - 1] : NULL;
+    if (last && last->a_start + last->a_len == x && last->b_start + last->b_len == y) {
+        last->a_len += dx;
+        last->b_len += dy;
+        return;
+    }
+    if (out->count == out->cap) {
+        out->cap = out->cap ? out->cap * 2 : 16;
+        out->hunks = realloc(out->hunks, sizeof(struct diffHunk) * out->cap);
+    }
+    out->hunks[out->count++] = (struct diffHunk){x, dx, y, dy};
+}
+
+/*** myers ***/
+// Diff a[0..n) against b[0..m) into out, offset by base. Returns -1 if
+// it takes more than DIFF_MAX_EDITS edits.
+static int diffMyers(const uint64_t *a, int n, const uint64_t *b, int m,
+        int base_a, int base_b, struct diffOut *out) {
+    int max = n + m;
+    if (max > DIFF_MAX_EDITS) max = DIFF_MAX_EDITS;
+    // v[k] is the furthest x on diagonal k, trace[d] is v before step d
+    // over k in [-d-1, d+1]
+    int *v = calloc(2 * max + 3, sizeof(int));
+    int **trace = calloc(max + 1, sizeof(int *));
+    int off = max + 1;
+    int found = -1;
+    for (int d = 0; d <= max && found == -1; d++) {
+        trace[d] = malloc(sizeof(int) * (2 * d + 3));
+        memcpy(trace[d], &v[off - d - 1], sizeof(int) * (2 * d + 3));
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+            if (k == -d || (k != d && v[off + k - 1] < v[off + k + 1])) x = v[off + k + 1];
+            else x = v[off + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            v[off + k] = x;
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+    }
+
+    if (found != -1) {
+        // Walk back from the end; edits come out last first
+        int *edits = malloc(sizeof(int) * 3 * (found + 1));
+        int nedits = 0;
+        int x = n, y = m;
+        for (int d = found; d > 0; d--) {
+            int *pv = trace[d] + d + 1;
+            int k = x - y;
+            int prev_k = (k == -d || (k != d && pv[k - 1] < pv[k + 1])) ? k + 1 : k - 1;
+            int prev_x = pv[prev_k];
+            int prev_y = prev_x - prev_k;
+            while (x > prev_x && y > prev_y) {
+                x--;
+                y--;
+            }
+            edits[nedits * 3] = prev_x;
+            edits[nedits * 3 + 1] = prev_y;
+            edits[nedits * 3 + 2] = prev_k == k + 1;
+            nedits++;
+            x = prev_x;
+            y = prev_y;
+        }
+        for (int i = nedits - 1; i >= 0; i--) {
+            int insert = edits[i * 3 + 2];
+            diffEdit(out, base_a + edits[i * 3], base_b + edits[i * 3 + 1], !insert, insert);
+        }
+        free(edits);
+    }
+
+    for (int d = 0; d <= max; d++) free(trace[d]);
+    free(trace);
+    free(v);
+    return found == -1 ? -1 : 0;
+}
+
+int diffLines(const uint64_t *a, int n, const uint64_t *b, int m, struct diffHunk **hunks) {
+    int prefix = 0;
+    while (prefix < n && prefix < m && a[prefix] == b[prefix]) prefix++;
+    int suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix &&
+            a[n - 1 - suffix] == b[m - 1 - suffix]) suffix++;
+
+    struct diffOut out = {NULL, 0, 0};
+    int an = n - prefix - suffix;
+    int bm = m - prefix - suffix;
+    if (an || bm) {
+        if (diffMyers(a + prefix, an, b + prefix, bm, prefix, prefix, &out) == -1) {
+            out.count = 0;
+            diffEdit(&out, prefix, prefix, an, bm);
+        }
+    }
+    *hunks = out.hunks;
+    return out.count;
+}
@@ -0,0 +1,28 @@
+#ifndef DIFF_H_
+#define DIFF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Line level diff over line hashes.
+ *
+ * Common leading and trailing lines are cut off first, the rest goes
+ * through Myers' O(ND) algorithm. If the two sides differ in more than
+ * DIFF_MAX_EDITS lines the middle is reported as a single hunk instead,
+ * which is still a correct diff, just not a minimal one.
+ */
+#define DIFF_MAX_EDITS 2048
+
+// Lines [a_start, a_start + a_len) of a became [b_start, b_start + b_len) of b
+struct diffHunk {
+    int a_start;
+    int a_len;
+    int b_start;
+    int b_len;
+};
+
+uint64_t diffHash(const char *s, size_t len);
+
+int diffLines(const uint64_t *a, int n, const uint64_t *b, int m, struct diffHunk **hunks);
+
+#endif
@@ -1,7 +1,18 @@
 #include "syntax.h"
+#include "bracket.h"
+#include "buffer.h"
 #include "draw.h"
+#include "decor.h"
+#include "editor.h"
 #include "editor_ops.h"
-#include "userinput.h"
+#include "eventloop.h"
+#include "fold.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "profile.h"
+#include "utf8.h"
+#include "view.h"
+#include "wrap.h"
 
 /*** append buffer ***/
 void abAppend(struct abuf *ab, const char *s, int len) {
@@ -18,11 +29,29 @@ void abFree(struct abuf *ab) {
 
 /*** output ***/
 void editorScroll(void) {
+    // A search, a jump or an edit may have put the cursor in a fold
+    if (foldHidden(E.cy)) foldOpen(E.cy);
+    if (foldHidden(E.rowoff)) {
+        E.rowoff = foldStart(E.rowoff);
+        E.wrapoff = 0;
+    }
     E.rx = 0;
     if (E.cy < E.numrows) {
         E.rx = editorCxToRx(&E.row[E.cy], E.cx);
     }
 
+    if (E.wrap) {
+        // Keep the cursor's line on screen, never scroll sideways
+        long long top = wrapLineOf(E.rowoff) + E.wrapoff;
+        long long line = wrapLineOf(E.cy);
+        int start;
+        if (E.cy < E.numrows) line += wrapSubOf(&E.row[E.cy], E.rx - E.lineno_offset, &start);
+        if (line < top) top = line;
+        if (line >= top + E.screenrows) top = line - E.screenrows + 1;
+        E.rowoff = wrapRowAt(top, &E.wrapoff);
+        E.coloff = 0;
+        return;
+    }
     if (E.rx < E.coloff) {
         E.coloff = E.rx;
     }
@@ -32,38 +61,67 @@ void editorScroll(void) {
     if (E.cy < E.rowoff) {
         E.rowoff = E.cy;
     }
-    if (E.cy >= E.rowoff + E.screenrows) {
-        E.rowoff = E.cy - E.screenrows + 1;
+    // Folded rows take no lines
+    int line = foldLineOf(E.cy);
+    if (line >= foldLineOf(E.rowoff) + E.screenrows) {
+        E.rowoff = foldRowAt(line - E.screenrows + 1);
     }
 }
 
-void editorDrawRows(struct abuf *ab) {
-    int inSelectionZone = 0;
-    for (int y = 0; y < E.screenrows; y++) {
-        // Clear this row
-        int filerow = y + E.rowoff;
-        if (filerow >= E.numrows) {
-            // Display upper third welcome message
-            if (E.numrows == 0 && y == E.screenrows / 3) {
-                char welcome[80];
-                int len = snprintf(welcome, sizeof(welcome),
-                        "Kilo editor -- version %s", KILO_VERSION);
-                // Truncate if necessary
-                if (len > E.screenrows) len = E.screenrows;
-                // Padding to center the message
-                int padding = (E.screencols - len  + 1) / 2;
-                abAppend(ab, "~", 1);
-                for (; padding > 0; padding--) abAppend(ab, " ", 1);
-                // Print it
-                abAppend(ab, welcome, len);
-            } else {
-                abAppend(ab, "~", 1);
-            }
+// Where the cursor is in the view
+void editorCursorPosition(int *y, int *x) {
+    if (E.wrap) {
+        int col = 0, sub = 0, start = 0;
+        if (E.cy < E.numrows) {
+            col = E.rx - E.lineno_offset;
+            sub = wrapSubOf(&E.row[E.cy], col, &start);
+        }
+        *y = wrapLineOf(E.cy) + sub - wrapLineOf(E.rowoff) - E.wrapoff;
+        *x = E.lineno_offset + col - start;
+        return;
+    }
+    *y = foldLineOf(E.cy) - foldLineOf(E.rowoff);
+    *x = E.rx - E.coloff;
+}
+
+// Draw screen row y without clearing the rest of the line. Returns how
+// many columns it took.
+int editorDrawRowText(struct abuf *ab, int y) {
+    int filerow = foldRowAt(foldLineOf(E.rowoff) + y), coloff = E.coloff, sub = 0;
+    int width = 1;
+    if (E.wrap) {
+        // The sub'th line of a wrapped row shows the sub'th slice of it
+        filerow = wrapRowAt(wrapLineOf(E.rowoff) + E.wrapoff + y, &sub);
+        coloff = filerow < E.numrows ? wrapSubStart(&E.row[filerow], sub) : 0;
+    }
+    if (filerow >= E.numrows) {
+        // Display upper third welcome message
+        if (E.numrows == 0 && !E.loader && y == E.screenrows / 3) {
+            char welcome[80];
+            int len = snprintf(welcome, sizeof(welcome),
+                    "Kilo editor -- version %s", KILO_VERSION);
+            // Truncate if necessary
+            if (len > E.screencols - 1) len = E.screencols - 1;
+            // Padding to center the message
+            int padding = (E.screencols - len  + 1) / 2;
+            if (padding + len > E.screencols - 1) padding = E.screencols - 1 - len;
+            width += padding + len;
+            abAppend(ab, "~", 1);
+            for (; padding > 0; padding--) abAppend(ab, " ", 1);
+            // Print it
+            abAppend(ab, welcome, len);
+        } else {
+            abAppend(ab, "~", 1);
+        }
+    } else {
+        // The line number takes the first columns of the screen
+        erow *row = &E.row[filerow];
+        int avail = E.screencols - E.lineno_offset;
+        if (avail < 0) avail = 0;
+        // Print line numbers, only on the first line of a wrapped row
+        if (sub > 0) {
+            for (int i = 0; i < E.lineno_offset; i++) abAppend(ab, " ", 1);
         } else {
-            int len = E.row[filerow].rsize - E.coloff;
-            if (len < 0) len = 0;
-            if (len > E.screencols) len = E.screencols;
-            // Print line numbers
             abAppend(ab, "\x1b[33m", 5); // yellow
             char lineno[36];
             int linenoLen = snprintf(lineno, sizeof(lineno), "%d",
@@ -73,30 +131,90 @@ void editorDrawRows(struct abuf *ab) {
             int padding = E.lineno_offset - curr;
             for (; padding > 0; padding--) abAppend(ab, " ", 1);
             abAppend(ab, "\x1b[39m", 5); // normal color
-            // Syntax highlighting
-            char *c = &E.row[filerow].render[E.coloff];
-            unsigned char *hl = &E.row[filerow].hl[E.coloff];
-            for (int i = 0; i < len; i++) {
-                // Code Selection
-                if (isInSelection(i, filerow)) abAppend(ab, "\x1b[7m", 4);
-
-                if (hl[i] == HL_NORMAL) {
-                    abAppend(ab, &c[i], 1);
-                } else {
-                    int color = editorSyntaxToColor(hl[i]);
-                    char buf[36];
-                    int colorLen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-                    abAppend(ab, buf, colorLen);
-                    abAppend(ab, &c[i], 1);
-                    abAppend(ab, "\x1b[39m", 5);
+        }
+        // Syntax highlighting
+        editorRowEnsureHl(row);
+        int raw = row->nsegs > 0;
+        // Matches and the selection go on top of the highlighting
+        struct decorSpan spans[KILO_DECOR_SPANS];
+        int nspans = decorRowSpans(row, filerow, spans, KILO_DECOR_SPANS);
+        nspans += bracketRowSpans(row, filerow, &spans[nspans], KILO_DECOR_SPANS - nspans);
+        // Half a wide character at the left edge shows as a blank
+        int rx, ri = editorRxToRender(row, coloff, &rx);
+        if (rx < coloff && ri < row->rsize) {
+            int cp;
+            ri += utf8Decode(&row->render[ri], row->rsize - ri, &cp);
+            rx += utf8Width(cp);
+            for (int i = coloff; i < rx && i - coloff < avail; i++) abAppend(ab, " ", 1);
+        }
+        while (ri < row->rsize && rx - coloff < avail) {
+            // Long rows render straight from chars, so mask here
+            char ch = row->render[ri];
+            int bytes = 1, cells = 1, cp;
+            if (raw) {
+                if (iscntrl((unsigned char)ch)) ch = ch == '\t' ? ' ' : '?';
+                else if ((unsigned char)ch >= 0x80) ch = '?';
+            } else if ((unsigned char)ch >= 0x80) {
+                bytes = utf8Decode(&row->render[ri], row->rsize - ri, &cp);
+                cells = utf8Width(cp);
+                // Nor does half of one at the right edge; wrapped, it
+                // goes to the next line whole
+                if (rx + cells - coloff > avail) {
+                    if (!E.wrap) {
+                        abAppend(ab, " ", 1);
+                        rx++;
+                    }
+                    break;
                 }
-                abAppend(ab, "\x1b[m", 3);
             }
-            abAppend(ab, "\x1b[39m", 5);
+
+            unsigned char face = row->hl[ri];
+            for (int k = 0; k < nspans; k++) {
+                if (rx < spans[k].start || rx >= spans[k].end) continue;
+                if (spans[k].kind == DECOR_SELECT) abAppend(ab, "\x1b[7m", 4);
+                else if (spans[k].kind == DECOR_MATCH) face = HL_MATCH;
+                else if (spans[k].kind == DECOR_BRACKET) abAppend(ab, "\x1b[1;4m", 6);
+            }
+
+            const char *text = bytes > 1 ? &row->render[ri] : &ch;
+            if (face == HL_NORMAL) {
+                abAppend(ab, text, bytes);
+            } else {
+                int color = editorSyntaxToColor(face);
+                char buf[36];
+                int colorLen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+                abAppend(ab, buf, colorLen);
+                abAppend(ab, text, bytes);
+                abAppend(ab, "\x1b[39m", 5);
+            }
+            abAppend(ab, "\x1b[m", 3);
+            ri += bytes;
+            rx += cells;
         }
-        abAppend(ab, "\x1b[K", 4);
-        abAppend(ab, "\r\n", 2);
+        // A closed fold tells how much it hides, after the last of its text
+        int hidden = foldEnd(filerow) - filerow;
+        if (hidden > 0 && ri >= row->rsize && rx >= coloff) {
+            char marker[32];
+            int len = snprintf(marker, sizeof(marker), " +%d line%s", hidden,
+                    hidden > 1 ? "s" : "");
+            if (len > avail - (rx - coloff)) len = avail - (rx - coloff);
+            if (len > 0) {
+                char buf[36];
+                int colorLen = snprintf(buf, sizeof(buf), "\x1b[%dm", editorSyntaxToColor(HL_COMMENT));
+                abAppend(ab, buf, colorLen);
+                abAppend(ab, marker, len);
+                rx += len;
+            }
+        }
+        abAppend(ab, "\x1b[39m", 5);
+        width = E.lineno_offset + (rx > coloff ? rx - coloff : 0);
     }
+    return width;
+}
+
+void editorDrawRow(struct abuf *ab, int y) {
+    editorDrawRowText(ab, y);
+    abAppend(ab, "\x1b[K", 4);
 }
 
 void editorDrawStatusBar(struct abuf *ab) {
@@ -104,12 +222,18 @@ void editorDrawStatusBar(struct abuf *ab) {
     abAppend(ab, "\x1b[7m", 4);
     char status[80];
     char fileloc[80];
+    char loading[16] = "";
+    char buffer[24] = "";
+    if (E.loader) snprintf(loading, sizeof(loading), " loading %d%%", editorLoadProgress());
+    else if (E.follow) snprintf(loading, sizeof(loading), " following");
+    if (bufferCount() > 1) snprintf(buffer, sizeof(buffer), "[%d/%d] ", bufferCurrent() + 1, bufferCount());
     // Display filename if there is one
-    int len = snprintf(status, sizeof(status), "%.20s - %d lines %s",
+    int len = snprintf(status, sizeof(status), "%s%.20s - %d lines%s%s", buffer,
             E.filename ? E.filename : "[No Name]", E.numrows,
-            E.dirty ? "(modified)" : "");
-    int fileloclen = snprintf(fileloc, sizeof(fileloc), "%s | %d,%d",
-            E.syntax ? E.syntax->filetype : "no filetype", E.cy + 1, E.cx + 1);
+            E.dirty ? " (modified)" : "", loading);
+    int fileloclen = snprintf(fileloc, sizeof(fileloc), "%s | %d,%d | byte %lld",
+            E.syntax ? E.syntax->filetype : "no filetype", E.cy + 1, E.cx + 1,
+            lineIndexOffset(E.cy, E.cx));
     if (len > E.screencols) len = E.screencols;
     // Display the status bar
     abAppend(ab, status, len);
@@ -123,45 +247,139 @@ void editorDrawStatusBar(struct abuf *ab) {
         }
     }
     abAppend(ab, "\x1b[m", 3);
-    abAppend(ab, "\r\n", 2);
 }
 
 void editorDrawMessageBar(struct abuf *ab) {
     abAppend(ab, "\x1b[K", 4);
-    int len = strlen(E.statusMessage);
-    if (len > E.screencols) len = E.screencols;
-    abAppend(ab, E.statusMessage, len);
+    // Profiler stats sit on the right, the message gets what is left
+    char stats[80];
+    int statslen = profileOverlay(stats, sizeof(stats)) ? strlen(stats) : 0;
+    if (statslen > viewTermCols()) statslen = viewTermCols();
+    int len = 0;
+    if (time(NULL) - E.statusmsg_time < KILO_STATUS_TIMEOUT) {
+        len = strlen(E.statusMessage);
+        if (len > viewTermCols() - statslen) len = viewTermCols() - statslen;
+        abAppend(ab, E.statusMessage, len);
+    }
+    if (statslen == 0) return;
+    for (; len < viewTermCols() - statslen; len++) abAppend(ab, " ", 1);
+    abAppend(ab, stats, statslen);
+}
+
+/*** frame cache ***/
+// What each screen line showed after the last frame, so a refresh only
+// sends the lines that changed. len == -1 means the line is unknown.
+struct frameLine {
+    char *b;
+    int len;
+};
+
+static struct frameLine *frame = NULL;
+static int frame_lines = 0;
+
+void editorInvalidateFrame(void) {
+    for (int y = 0; y < frame_lines; y++) frame[y].len = -1;
+}
+
+static void editorFrameResize(int lines) {
+    for (int y = lines; y < frame_lines; y++) free(frame[y].b);
+    frame = realloc(frame, sizeof(struct frameLine) * lines);
+    for (int y = frame_lines; y < lines; y++) {
+        frame[y].b = NULL;
+        frame[y].len = -1;
+    }
+    frame_lines = lines;
+}
+
+// Queue screen line y if it differs from the last frame. Takes ownership
+// of the line's buffer.
+static void editorFlushLine(struct abuf *ab, int y, struct abuf *line) {
+    if (frame[y].len == line->len && memcmp(frame[y].b, line->b, line->len) == 0) {
+        abFree(line);
+        return;
+    }
+    char pos[30];
+    int len = snprintf(pos, sizeof(pos), "\x1b[%d;1H", y + 1);
+    abAppend(ab, pos, len);
+    abAppend(ab, line->b, line->len);
+    free(frame[y].b);
+    frame[y].b = line->b;
+    frame[y].len = line->len;
+}
+
+// Apply a new terminal size. Only width dependent state is recomputed;
+// the next refresh sends just the lines that look different at this size.
+void editorResize(int rows, int cols) {
+    int shrunk = rows < viewTermRows() || cols < viewTermCols();
+    int old_cols = E.screencols;
+    // Every view gets its share, E the size of the current one
+    viewResize(rows, cols);
+    int grown = E.screencols > old_cols;
+    // A wider screen can show more of the row left of the cursor
+    if (grown && E.coloff > 0) {
+        int coloff = E.rx - E.screencols + 1;
+        E.coloff = coloff > 0 ? coloff : 0;
+    }
+    if (!E.wrap && foldLineOf(E.cy) >= foldLineOf(E.rowoff) + E.screenrows) {
+        E.rowoff = foldRowAt(foldLineOf(E.cy) - E.screenrows + 1);
+    }
+    // Terminals truncate or reflow the cells a shrink cuts off, each in
+    // their own way, so nothing on screen can be trusted after one
+    if (shrunk) editorInvalidateFrame();
+    eventLoopRequestRedraw();
 }
 
 void editorRefreshScreen(void) {
+    PROFILE_BEGIN(PROF_REFRESH);
     editorScroll();
+    editorEnforceMemBudget();
+    int canvas = viewTermRows() - 1;
+    if (frame_lines != canvas + 1) editorFrameResize(canvas + 1);
     // ANSI Escape Codes
     // https://vt100.net/docs/vt100-ug/chapter3.html
     struct abuf ab = ABUF_INIT;
     // Hide the cursor
     abAppend(&ab, "\x1b[?25l", 6);
-    abAppend(&ab, "\x1b[H", 3);
-    // Redraw canvas
-    editorDrawRows(&ab);
-    editorDrawStatusBar(&ab);
-    editorDrawMessageBar(&ab);
+    // Views only draw their rows again when those changed, the canvas
+    // only sends the lines that look different
+    viewRender();
+    for (int y = 0; y < canvas; y++) {
+        struct abuf line = ABUF_INIT;
+        viewDrawLine(&line, y);
+        editorFlushLine(&ab, y, &line);
+    }
+    struct abuf message = ABUF_INIT;
+    editorDrawMessageBar(&message);
+    editorFlushLine(&ab, canvas, &message);
     // Position cursor
     char pos[30];
-    int len = snprintf(pos, sizeof(pos), "\x1b[%d;%dH", (E.cy - E.rowoff) + 1,
-            (E.rx - E.coloff) + 1);
+    int cy, cx;
+    viewCursor(&cy, &cx);
+    int len = snprintf(pos, sizeof(pos), "\x1b[%d;%dH", cy + 1, cx + 1);
     abAppend(&ab, pos, len);
     // Reveal cursor
     abAppend(&ab, "\x1b[?25h", 6);
 
-    write(STDOUT_FILENO, ab.b, ab.len);
+    editorWrite(ab.b, ab.len);
+    PROFILE_FRAME(ab.len);
     abFree(&ab);
+    PROFILE_END(PROF_REFRESH);
+}
+
+static void editorStatusExpired(void *arg) {
+    (void)arg;
+    eventLoopRequestRedraw();
 }
 
 void editorSetStatusMessage(const char *fmt, ...) {
+    static int timer = -1;
     va_list ap;
     va_start(ap, fmt);
     vsnprintf(E.statusMessage, sizeof(E.statusMessage), fmt, ap);
     va_end(ap);
     E.statusmsg_time = time(NULL);
+    // Redraw once the message has gone stale so it disappears on its own
+    if (timer == -1) timer = eventLoopAddTimer(editorStatusExpired, NULL);
+    eventLoopArmTimer(timer, KILO_STATUS_TIMEOUT * 1000, 0);
 }
 
@@ -14,12 +14,20 @@ void abFree(struct abuf *ab);
 
 void editorScroll(void);
 
-void editorDrawRows(struct abuf *ab);
+void editorCursorPosition(int *y, int *x);
+
+int editorDrawRowText(struct abuf *ab, int y);
+
+void editorDrawRow(struct abuf *ab, int y);
 
 void editorDrawStatusBar(struct abuf *ab);
 
 void editorDrawMessageBar(struct abuf *ab);
 
+void editorInvalidateFrame(void);
+
+void editorResize(int rows, int cols);
+
 void editorRefreshScreen(void);
 
 void editorSetStatusMessage(const char *fmt, ...);
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "rowalloc.h"
+#include "editor.h"
+
+/*** data ***/
+struct editorConfig E;
+
+/*** output ***/
+static void editorWriteStdout(const char *s, int len) {
+    while (len > 0) {
+        int n = write(STDOUT_FILENO, s, len);
+        if (n <= 0) return;
+        s += n;
+        len -= n;
+    }
+}
+
+static void (*editor_output)(const char *s, int len) = editorWriteStdout;
+
+void editorSetOutput(void (*output)(const char *s, int len)) {
+    editor_output = output ? output : editorWriteStdout;
+}
+
+void editorWrite(const char *s, int len) {
+    editor_output(s, len);
+}
+
+void die(const char *s) {
+    editorWrite("\x1b[2J", 4);
+    editorWrite("\x1b[H", 3);
+    perror(s);
+    exit(1);
+}
+
+/*** init ***/
+void initEditor(void) {
+    /* Initialize the E struct */
+    E.cx = 0;
+    E.cy = 0;
+    E.rx = 0;
+    E.cursor_pos = 0;
+    E.rowoff = 0;
+    E.coloff = 0;
+    E.wrap = 0;
+    E.wrapoff = 0;
+    E.row = NULL;
+    E.rowcap = 0;
+    E.arena = rowArenaNew();
+    E.hl_arena = rowArenaNew();
+    E.dirty = 0;
+    E.version = 0;
+    E.filename = NULL;
+    E.copy_buffer = NULL;
+    E.prev_char = ' ';
+    E.lineno_offset = 2;
+    E.statusMessage[0] = '\0';
+    E.statusmsg_time = 0;
+    E.syntax = NULL;
+    E.snapshot = NULL;
+    E.loader = NULL;
+    E.journal = NULL;
+    E.follow = NULL;
+    E.watch = NULL;
+    E.saved = NULL;
+    E.decor = NULL;
+    E.wraps = NULL;
+    E.folds = NULL;
+    E.brackets = NULL;
+    E.offsets = NULL;
+    E.file_bytes = 0;
+    E.select_end_x = 0;
+    E.select_end_y = 0;
+    E.select_start_x = 0;
+    E.select_start_y = 0;
+    // Until someone reports a real size
+    E.screenrows = 24 - 2;
+    E.screencols = 80;
+}
@@ -0,0 +1,16 @@
+#ifndef EDITOR_H_
+#define EDITOR_H_
+
+/* Editor core without a terminal.
+ *
+ * Everything except terminal.c and kilo.c builds into libkilo.a and never
+ * touches the TTY itself: keys come in through editorFeedInput and frames
+ * go out through the output set here, stdout unless told otherwise.
+ */
+void initEditor(void);
+
+void editorSetOutput(void (*output)(const char *s, int len));
+
+void editorWrite(const char *s, int len);
+
+#endif
@@ -1,35 +1,332 @@
+#include "bracket.h"
+#include "draw.h"
+#include "decor.h"
 #include "editor_ops.h"
+#include "fold.h"
+#include "journal.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "memory.h"
+#include "profile.h"
+#include "rowalloc.h"
+#include "snapshot.h"
 #include "syntax.h"
 #include "userinput.h"
+#include "utf8.h"
+#include "wrap.h"
+
+/*** column maps ***/
+// Rows with a materialized render keep a sorted list of the characters
+// whose width differs from their size in chars: tabs and multibyte UTF-8
+// sequences. It is built on first use after an edit, so converting a
+// column is a binary search over it. With map NULL this only counts;
+// *width, if given, gets the columns of the whole row.
+static int editorScanColmap(erow *row, struct colmapEntry *map, int *width) {
+    int i = 0, rx = 0, ri = 0, n = 0, cp;
+    while (i < row->size) {
+        int plain = utf8Plain(&row->chars[i], row->size - i);
+        i += plain;
+        rx += plain;
+        ri += plain;
+        if (i == row->size) break;
+
+        int len = 1, width, bytes;
+        if (row->chars[i] == '\t') {
+            width = bytes = KILO_TAB_STOP - (rx % KILO_TAB_STOP);
+        } else if ((len = utf8Decode(&row->chars[i], row->size - i, &cp)) > 1) {
+            width = utf8Width(cp);
+            bytes = len;
+        } else {
+            // Control characters and stray bytes are a '?' each
+            i++;
+            rx++;
+            ri++;
+            continue;
+        }
+        if (map) {
+            map[n].cx = i;
+            map[n].rx = rx;
+            map[n].ri = ri;
+            map[n].len = len;
+            map[n].width = width;
+        }
+        n++;
+        i += len;
+        rx += width;
+        ri += bytes;
+    }
+    if (width) *width = rx;
+    return n;
+}
+
+static void editorBuildColmap(erow *row) {
+    int count = editorScanColmap(row, NULL, NULL);
+    row->colmap = count ? memRowAlloc(E.arena, MEM_LAYOUT, sizeof(struct colmapEntry) * count) : NULL;
+    row->colmap_len = count;
+    if (count) editorScanColmap(row, row->colmap, NULL);
+}
+
+// Bytes the entry takes in render: tabs become spaces
+static int editorColmapBytes(erow *row, struct colmapEntry *e) {
+    return row->chars[e->cx] == '\t' ? e->width : e->len;
+}
+
+static void editorFreeColmap(erow *row) {
+    memRowFree(E.arena, MEM_LAYOUT, row->colmap);
+    row->colmap = NULL;
+    row->colmap_len = -1;
+}
+
+/*** long lines ***/
+// Rows longer than KILO_LONG_LINE are split into segments of about
+// KILO_SEGMENT_SIZE bytes, each remembering the highlight state it starts
+// in. Their render is always a view onto chars, and an edit only touches
+// the segments around it.
+static int editorIsLongRow(erow *row) {
+    if (row->nsegs) return row->size >= KILO_LONG_LINE / 2;
+    return row->size > KILO_LONG_LINE;
+}
+
+static void editorBuildSegments(erow *row) {
+    int n = (row->size + KILO_SEGMENT_SIZE - 1) / KILO_SEGMENT_SIZE;
+    row->segs = memRowRealloc(E.arena, MEM_LAYOUT, row->segs, sizeof(struct rowSegment) * n);
+    row->nsegs = n;
+    for (int k = 0; k < n; k++) {
+        row->segs[k].start = k * KILO_SEGMENT_SIZE;
+        row->segs[k].len = KILO_SEGMENT_SIZE;
+        row->segs[k].bracket_low = 1;
+    }
+    row->segs[n - 1].len = row->size - row->segs[n - 1].start;
+}
+
+static void editorFreeSegments(erow *row) {
+    memRowFree(E.arena, MEM_LAYOUT, row->segs);
+    row->segs = NULL;
+    row->nsegs = 0;
+}
+
+// Last segment starting at or before `at`
+static int editorFindSegment(erow *row, int at) {
+    int lo = 0, hi = row->nsegs;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (row->segs[mid].start <= at) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+static void editorSplitSegment(erow *row, int k) {
+    int pieces = (row->segs[k].len + KILO_SEGMENT_SIZE - 1) / KILO_SEGMENT_SIZE;
+    if (pieces < 2) return;
+    row->segs = memRowRealloc(E.arena, MEM_LAYOUT, row->segs,
+            sizeof(struct rowSegment) * (row->nsegs + pieces - 1));
+    memmove(&row->segs[k + pieces], &row->segs[k + 1],
+            sizeof(struct rowSegment) * (row->nsegs - k - 1));
+    int start = row->segs[k].start, len = row->segs[k].len;
+    for (int j = 0; j < pieces; j++) {
+        struct rowSegment *seg = &row->segs[k + j];
+        seg->start = start + j * KILO_SEGMENT_SIZE;
+        seg->len = j == pieces - 1 ? len - j * KILO_SEGMENT_SIZE : KILO_SEGMENT_SIZE;
+        // New segments have no recorded entry state yet
+        if (j > 0) {
+            seg->state.skip = -1;
+            seg->bracket_low = 1;
+        }
+    }
+    row->nsegs += pieces - 1;
+}
+
+// chars already holds the edit: `delta` bytes were inserted (or removed,
+// when negative) at `at`.
+static void editorUpdateLongRow(erow *row, int at, int delta) {
+    int i;
+    for (i = 0; i < row->size && row->chars[i] == ' '; i++);
+    row->indent = i;
+    row->render = row->chars;
+    row->rsize = row->size;
+
+    int k = editorFindSegment(row, at);
+    if (delta < 0 && at >= row->segs[k].start + row->segs[k].len) k++;
+    row->segs[k].len += delta;
+    for (int j = k + 1; j < row->nsegs; j++) row->segs[j].start += delta;
+    if (row->segs[k].len == 0 && row->nsegs > 1) {
+        memmove(&row->segs[k], &row->segs[k + 1],
+                sizeof(struct rowSegment) * (row->nsegs - k - 1));
+        row->nsegs--;
+        if (k == row->nsegs) k--;
+    } else if (row->segs[k].len > 2 * KILO_SEGMENT_SIZE) {
+        editorSplitSegment(row, k);
+    }
+
+    if (delta > 0) {
+        row->hl = memRowRealloc(E.hl_arena, MEM_HL, row->hl, row->rsize);
+        memmove(&row->hl[at + delta], &row->hl[at], row->rsize - at - delta);
+    } else {
+        memmove(&row->hl[at], &row->hl[at - delta], row->rsize - at);
+        row->hl = memRowRealloc(E.hl_arena, MEM_HL, row->hl, row->rsize);
+    }
+
+    // Keywords and comment delimiters look ahead, so a change can alter
+    // how the bytes just before it are highlighted
+    int from = editorFindSegment(row, at > KILO_SYNTAX_LOOKBACK ?
+            at - KILO_SYNTAX_LOOKBACK : 0);
+    editorUpdateSyntaxSegments(row, from, k);
+}
+
+static void editorRowEdited(erow *row, int at, int delta) {
+    if (row->nsegs && editorIsLongRow(row) && row->hl) {
+        editorUpdateLongRow(row, at, delta);
+    } else {
+        editorUpdateRow(row);
+    }
+    wrapRowChanged(row);
+    lineIndexRowChanged(row);
+}
+
+/*** memory budget ***/
+// Over budget, hl goes first: it is rebuilt from chars and the saved
+// comment state whenever a row is drawn again. hl has an arena of its
+// own, so dropping all of it hands whole chunks back to the kernel and
+// the next frame rebuilds just the visible rows. Each pass walks every
+// row, so another one only runs once a sixteenth of the budget in new hl
+// has piled up.
+void editorEnforceMemBudget(void) {
+    static int degraded = 0;
+    size_t budget = memBudget();
+    if (budget == 0 || memTotalBytes() <= budget) {
+        degraded = 0;
+        return;
+    }
+    if (memTagBytes(MEM_HL) < budget / 16) return;
+
+    for (int i = 0; i < E.numrows; i++) E.row[i].hl = NULL;
+    memArenaReset(E.hl_arena);
+    if (!degraded) {
+        editorSetStatusMessage("Over memory budget: only highlighting visible rows");
+        degraded = 1;
+    }
+}
 
 /*** row operations ***/
 int editorCxToRx(erow *row, int cx) {
-    int rx = 0;
-    for(int i = 0; i < cx; i++) {
-        if (row->chars[i] == '\t') {
-            rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
+    if (!row->render_owned) return cx + E.lineno_offset;
+    if (row->colmap_len == -1) editorBuildColmap(row);
+
+    // Find the last wide character that starts before cx
+    int lo = 0, hi = row->colmap_len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (row->colmap[mid].cx < cx) lo = mid + 1;
+        else hi = mid;
+    }
+    int rx = cx;
+    if (lo > 0) {
+        struct colmapEntry *e = &row->colmap[lo - 1];
+        rx = e->rx + e->width + (cx - e->cx - e->len);
+    }
+    return rx + E.lineno_offset;
+}
+
+// Columns the whole row takes, without building a column map for it
+int editorRowWidth(erow *row) {
+    if (!row->render_owned) return row->size;
+    if (row->colmap_len != -1) return editorCxToRx(row, row->size) - E.lineno_offset;
+    int width;
+    editorScanColmap(row, NULL, &width);
+    return width;
+}
+
+// Whether row may have characters two columns wide. Only a row with a
+// column map is sure to, any other without a byte past ASCII is sure not to.
+int editorRowWide(erow *row) {
+    if (!row->render_owned) return 0;
+    if (row->colmap_len == -1) {
+        for (int i = 0; i < row->size; i++) {
+            if ((unsigned char)row->chars[i] >= 0x80) return 1;
         }
-        rx++;
+        return 0;
+    }
+    for (int k = 0; k < row->colmap_len; k++) {
+        if (row->colmap[k].width > 1 && row->chars[row->colmap[k].cx] != '\t') return 1;
     }
-    rx += E.lineno_offset;
-    return rx;
+    return 0;
 }
 
 int editorRxToCx(erow *row, int rx) {
-  int cur_rx = 0;
-  int cx;
-  for (cx = 0; cx < row->size; cx++) {
-    if (row->chars[cx] == '\t')
-      cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-    cur_rx++;
-    if (cur_rx > rx) return cx;
-  }
-  return cx;
+    int cx = rx;
+    if (row->render_owned) {
+        if (row->colmap_len == -1) editorBuildColmap(row);
+
+        // Find the last wide character that starts at or before rx
+        int lo = 0, hi = row->colmap_len;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (row->colmap[mid].rx <= rx) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo > 0) {
+            struct colmapEntry *e = &row->colmap[lo - 1];
+            if (rx < e->rx + e->width) return e->cx;
+            cx = e->cx + e->len + (rx - e->rx - e->width);
+        }
+    }
+    if (cx > row->size) cx = row->size;
+    return cx;
+}
+
+// Offset in render of the character shown at column rx, not counting the
+// line numbers. *start is the column it starts at, left of rx when that
+// is the second half of a wide character.
+int editorRxToRender(erow *row, int rx, int *start) {
+    *start = rx;
+    if (!row->render_owned) return rx;
+    if (row->colmap_len == -1) editorBuildColmap(row);
+
+    int lo = 0, hi = row->colmap_len;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (row->colmap[mid].rx <= rx) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return rx;
+    struct colmapEntry *e = &row->colmap[lo - 1];
+    if (rx < e->rx + e->width) {
+        // Any of a tab's spaces will do
+        if (row->chars[e->cx] == '\t') return e->ri + (rx - e->rx);
+        *start = e->rx;
+        return e->ri;
+    }
+    return e->ri + editorColmapBytes(row, e) + (rx - e->rx - e->width);
+}
+
+// Offset in chars of the character at render offset ri
+int editorRenderToCx(erow *row, int ri) {
+    int cx = ri;
+    if (row->render_owned) {
+        if (row->colmap_len == -1) editorBuildColmap(row);
+
+        int lo = 0, hi = row->colmap_len;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (row->colmap[mid].ri <= ri) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo > 0) {
+            struct colmapEntry *e = &row->colmap[lo - 1];
+            int bytes = editorColmapBytes(row, e);
+            if (ri < e->ri + bytes) return e->cx;
+            cx = e->cx + e->len + (ri - e->ri - bytes);
+        }
+    }
+    if (cx > row->size) cx = row->size;
+    return cx;
 }
 
 void editorUpdateRow(erow *row) {
-    row->render = malloc(row->size + 1);
-    int i, leading_spaces = 0;
+    PROFILE_BEGIN(PROF_UPDATE_ROW);
+    int i, leading_spaces = 0, tabs = 0;
+    int long_row = editorIsLongRow(row);
     // Get leading spaces
     for (i = 0; i < row->size; i++) {
         if (row->chars[i] == ' ') {
@@ -39,84 +336,211 @@ void editorUpdateRow(erow *row) {
         }
     }
     row->indent = leading_spaces;
-    free(row->render);
-    row->render = malloc(row->size + 1);
+    // Most rows are printable ASCII all the way, and found so a word at a
+    // time; the rest only gets looked at byte by byte past that
+    int plain = long_row ? row->size : utf8Plain(row->chars, row->size);
+    for (i = plain; i < row->size; i++) {
+        if (row->chars[i] == '\t') tabs++;
+    }
 
-    // Fill render buffer
-    int idx = 0;
-    for(i = 0; i < row->size; i++) {
-        row->render[idx++] = row->chars[i];
+    if (row->render_owned) memRowFree(E.arena, MEM_RENDER, row->render);
+    editorFreeColmap(row);
+    if (long_row) {
+        // Long rows show tabs, control characters and every byte of UTF-8
+        // as one cell each
+        row->render = row->chars;
+        row->render_owned = 0;
+        row->rsize = row->size;
+        editorBuildSegments(row);
+        editorUpdateSyntax(row);
+        PROFILE_END(PROF_UPDATE_ROW);
+        return;
+    }
+    if (row->nsegs) editorFreeSegments(row);
+    if (plain == row->size) {
+        // Nothing to transform: render is a view onto chars
+        row->render = row->chars;
+        row->render_owned = 0;
+        row->rsize = row->size;
+        editorUpdateSyntax(row);
+        PROFILE_END(PROF_UPDATE_ROW);
+        return;
+    }
+
+    // Fill render buffer, expanding tabs to the next stop, keeping valid
+    // UTF-8 and masking control characters and stray bytes
+    row->render = memRowAlloc(E.arena, MEM_RENDER, row->size + tabs * (KILO_TAB_STOP - 1) + 1);
+    row->render_owned = 1;
+    int idx = 0, col = 0, cp;
+    i = 0;
+    while (i < row->size) {
+        int n = utf8Plain(&row->chars[i], row->size - i);
+        memcpy(&row->render[idx], &row->chars[i], n);
+        i += n;
+        idx += n;
+        col += n;
+        if (i == row->size) break;
+        if (row->chars[i] == '\t') {
+            do {
+                row->render[idx++] = ' ';
+            } while (++col % KILO_TAB_STOP != 0);
+            i++;
+        } else if ((n = utf8Decode(&row->chars[i], row->size - i, &cp)) > 1) {
+            memcpy(&row->render[idx], &row->chars[i], n);
+            i += n;
+            idx += n;
+            col += utf8Width(cp);
+        } else {
+            row->render[idx++] = '?';
+            i++;
+            col++;
+        }
     }
     row->render[idx] = '\0';
     row->rsize = idx;
 
     editorUpdateSyntax(row);
+    PROFILE_END(PROF_UPDATE_ROW);
 }
 
 void editorInsertRow(int at, char *s, size_t len) {
     if (at < 0 || at > E.numrows) return;
-    E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
+    // Grow geometrically, loading appends rows one at a time
+    if (E.numrows + 1 > E.rowcap) {
+        E.rowcap = E.rowcap ? E.rowcap * 2 : 16;
+        E.row = memRealloc(MEM_ROWS, E.row, sizeof(erow) * E.rowcap);
+    }
     memmove(&E.row[at+1], &E.row[at], sizeof(erow) * (E.numrows - at));
     for (int j = at + 1; j <= E.numrows; j++) E.row[j].idx++;
 
     E.row[at].idx = at;
 
     E.row[at].size = len;
-    E.row[at].chars = malloc(len + 1);
+    // A save ends every row with a newline, the one before it included
+    E.row[at].eol = 1;
+    if (at == E.numrows && at > 0 && E.row[at - 1].eol == 0) {
+        E.row[at - 1].eol = 1;
+        lineIndexRowChanged(&E.row[at - 1]);
+    }
+    E.row[at].chars = memRowAlloc(E.arena, MEM_CHARS, len + 1);
     memcpy(E.row[at].chars, s, len);
     E.row[at].chars[len] = '\0';
 
     E.row[at].render = NULL;
+    E.row[at].render_owned = 0;
     E.row[at].rsize = 0;
+    E.row[at].colmap = NULL;
+    E.row[at].colmap_len = -1;
+    E.row[at].segs = NULL;
+    E.row[at].nsegs = 0;
     E.row[at].hl_open_comment = 0;
     E.row[at].hl = NULL;
+    // Rows after it move before it is highlighted into the bracket index
+    bracketInsertRow(at);
     editorUpdateRow(&E.row[at]);
+    foldInsertRow(at);
+    wrapInsertRow(at);
+    lineIndexInsertRow(at);
+    snapshotInsertLine(at, s, len);
+    journalRecord(JOURNAL_INSERT_ROW, at, 0, s, len);
 
     E.numrows++;
     E.lineno_offset = floor (log10 (abs (E.numrows))) + 2;
     E.dirty++;
+    E.version++;
 }
 
 void editorFreeRow(erow *row) {
-    free(row->chars);
-    free(row->render);
-    free(row->hl);
+    memRowFree(E.arena, MEM_CHARS, row->chars);
+    if (row->render_owned) memRowFree(E.arena, MEM_RENDER, row->render);
+    memRowFree(E.arena, MEM_LAYOUT, row->colmap);
+    memRowFree(E.arena, MEM_LAYOUT, row->segs);
+    memRowFree(E.hl_arena, MEM_HL, row->hl);
+}
+
+void editorFreeRows(void) {
+    // Row payloads all live in the arenas, so there is nothing to walk
+    memArenaReset(E.arena);
+    memArenaReset(E.hl_arena);
+    snapshotReset();
+    foldFree();
+    wrapFree();
+    lineIndexFree();
+    bracketFree();
+    memFree(MEM_ROWS, E.row);
+    E.row = NULL;
+    E.rowcap = 0;
+    E.numrows = 0;
+    E.cx = 0;
+    E.cy = 0;
+    E.rowoff = 0;
+    E.coloff = 0;
+    E.version++;
 }
 
 void editorDelRow(int at) {
     if (at < 0 || at >= E.numrows) return;
     editorFreeRow(&E.row[at]);
+    foldDelRow(at);
+    wrapDelRow(at);
+    bracketDelRow(at);
+    lineIndexDelRow(at);
+    snapshotDelLine(at);
+    journalRecord(JOURNAL_DEL_ROW, at, 0, NULL, 0);
     memmove(&E.row[at], &E.row[at+1], sizeof(erow) * (E.numrows - at - 1));
     for (int j = at; j <= E.numrows - 1; j++) E.row[j].idx--;
     E.numrows--;
     E.lineno_offset = floor (log10 (abs (E.numrows))) + 2;
     E.dirty++;
+    E.version++;
 }
 
 void editorRowInsertChar(erow *row, int at, int c) {
-    row->chars = realloc(row->chars, row->size + 2);
+    row->chars = memRowRealloc(E.arena, MEM_CHARS, row->chars, row->size + 2);
     memmove(&row->chars[at+1], &row->chars[at], row->size - at + 1);
     row->size++;
     row->chars[at] = c;
-    editorUpdateRow(row);
+    editorRowEdited(row, at, 1);
+    snapshotSetLine(row->idx, row->chars, row->size);
+    journalRecord(JOURNAL_INSERT_CHAR, row->idx, at, &row->chars[at], 1);
     E.dirty++;
+    E.version++;
 }
 
 void editorRowAppendString(erow *row, char *s, size_t len) {
-    row->chars = realloc(row->chars, row->size + len + 1);
+    row->chars = memRowRealloc(E.arena, MEM_CHARS, row->chars, row->size + len + 1);
     memcpy(&row->chars[row->size], s, len);
     row->size += len;
     row->chars[row->size] = '\0';
-    editorUpdateRow(row);
+    editorRowEdited(row, row->size - len, len);
+    snapshotSetLine(row->idx, row->chars, row->size);
+    journalRecord(JOURNAL_APPEND, row->idx, 0, s, len);
     E.dirty++;
+    E.version++;
 }
 
 void editorRowDelChar(erow *row, int at) {
     if (at < 0 || at >= row->size) return;
     memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
     row->size--;
+    editorRowEdited(row, at, -1);
+    snapshotSetLine(row->idx, row->chars, row->size);
+    journalRecord(JOURNAL_DEL_CHAR, row->idx, at, NULL, 0);
+    E.dirty++;
+    E.version++;
+}
+
+void editorRowTruncate(erow *row, int len) {
+    if (len < 0 || len > row->size) return;
+    row->size = len;
+    row->chars[len] = '\0';
     editorUpdateRow(row);
+    wrapRowChanged(row);
+    lineIndexRowChanged(row);
+    snapshotSetLine(row->idx, row->chars, row->size);
+    journalRecord(JOURNAL_TRUNCATE, row->idx, len, NULL, 0);
     E.dirty++;
+    E.version++;
 }
 
 /*** editor operations ***/
@@ -158,10 +582,7 @@ void editorInsertNewLine(void) {
         }
         memcpy(&s[idx], &row->chars[E.cx], row->size - E.cx);
         editorInsertRow(E.cy + 1, s, len);
-        row = &E.row[E.cy];
-        row->size = E.cx;
-        row->chars[row->size] = '\0';
-        editorUpdateRow(row);
+        editorRowTruncate(&E.row[E.cy], E.cx);
         free(s);
     }
     E.cy++;
@@ -176,16 +597,24 @@ void editorDelChar(void) {
         editorDelRow(E.cy);
         E.cy--;
     } else if (E.cx != 0 && E.cy >= 0) {
-        editorRowDelChar(&E.row[E.cy], E.cx - 1);
-        E.cx--;
+        // The whole character, with any marks on it
+        erow *row = &E.row[E.cy];
+        int at = utf8Prev(row->chars, row->size, E.cx);
+        while (E.cx > at) {
+            editorRowDelChar(row, E.cx - 1);
+            E.cx--;
+        }
     }
 }
 
 /*** find ***/
 static int searchOffset = 0;
 void editorFindCallback(char *query, int key) {
+    PROFILE_BEGIN(PROF_FIND);
+    decorClear(DECOR_MATCH);
     if (key == '\r' || key == '\x1b') {
         searchOffset = 0;
+        PROFILE_END(PROF_FIND);
         return;
     }
     if (key == ARROW_RIGHT || key == ARROW_DOWN) {
@@ -202,11 +631,12 @@ void editorFindCallback(char *query, int key) {
         char *match = strstr(row->render, query);
         if (match) {
             if (currSearchOffset <= 0) {
+                int ri = match - row->render;
                 matchFound = 1;
                 E.cy = i;
-                E.cx = editorRxToCx(row, match - row->render);
+                E.cx = editorRenderToCx(row, ri);
                 E.rowoff = E.numrows;
-                memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
+                decorAdd(DECOR_MATCH, i, E.cx, i, editorRenderToCx(row, ri + strlen(query)));
                 break;
             } else {
                 currSearchOffset--;
@@ -216,6 +646,7 @@ void editorFindCallback(char *query, int key) {
     if (!matchFound && searchOffset > 0) {
         searchOffset--;
     }
+    PROFILE_END(PROF_FIND);
 }
 
 void editorFind(void) {
@@ -223,7 +654,6 @@ void editorFind(void) {
     int orig_cy = E.cy;
     int orig_rowoff = E.rowoff;
     int orig_coloff = E.coloff;
-    unsigned char *orig_hl = E.row->hl;
 
     char *query = editorPrompt("Search: %s (Arrows to navigate | ESC to cancel)", editorFindCallback);
     if (query) {
@@ -233,10 +663,6 @@ void editorFind(void) {
         E.cy = orig_cy;
         E.rowoff = orig_rowoff;
         E.coloff = orig_coloff;
-        E.row->hl = orig_hl;
-    }
-    for (int i = 0; i < E.numrows; i++) {
-        editorUpdateSyntax(&E.row[i]);
     }
 }
 
@@ -247,22 +673,27 @@ void editorMoveCursor(int key) {
 
     switch(key) {
         case ARROW_UP:
-            if (E.cy > 0) E.cy--;
+            // Over any fold, onto its first row
+            if (E.cy > 0) E.cy = foldStart(E.cy - 1);
             break;
         case ARROW_LEFT:
-            if (E.cx > 0) {
-                E.cx--;
+            if (row && E.cx > 0) {
+                E.cx = utf8Prev(row->chars, row->size, E.cx);
             }
             E.cursor_pos = E.cx;
             break;
         case ARROW_DOWN:
-            if (E.cy < (E.numrows - 1)) {
-                E.cy++;
+            {
+                // Past the rows folded into this one. The next row may
+                // still be on its way from disk.
+                int next = foldEnd(E.cy) + 1;
+                editorLoadWaitRow(next);
+                if (next < E.numrows) E.cy = next;
+                break;
             }
-            break;
         case ARROW_RIGHT:
             if (row && E.cx < row->size) {
-                E.cx++;
+                E.cx = utf8Next(row->chars, row->size, E.cx);
             }
             E.cursor_pos = E.cx;
             break;
@@ -275,6 +706,8 @@ void editorMoveCursor(int key) {
         E.cx = row->size;
     } else {
         E.cx = E.cursor_pos;
+        // Not in the middle of a character
+        while (row && E.cx > 0 && (row->chars[E.cx] & 0xc0) == 0x80) E.cx--;
     }
 }
 
@@ -7,18 +7,59 @@
 #define KILO_TAB_STOP 4
 #define KILO_VERSION "0.0.1"
 #define CTRL_KEY(k) ((k) & 0x1f)
+#define KILO_ESCAPE_TIMEOUT 100
+#define KILO_STATUS_TIMEOUT 5
+#define KILO_RESIZE_DELAY 30
+// Background loading reads this much at a time, with this many pieces queued
+#define KILO_LOAD_CHUNK (64 * 1024)
+#define KILO_LOAD_INFLIGHT 4
+// Files from this size on keep a line cache for the next load
+#define KILO_CACHE_MIN_SIZE (1024 * 1024)
+// Journal batches are fsync'd this often (ms), autosaves this often (s)
+#define KILO_JOURNAL_SYNC 200
+#define KILO_AUTOSAVE_INTERVAL 30
+// Follow mode looks again this often (ms) while the file is still loading
+#define KILO_FOLLOW_RETRY 100
+// Changes on disk are looked at once writes pause for this long (ms)
+#define KILO_WATCH_DELAY 50
+#define KILO_LONG_LINE (64 * 1024)
+#define KILO_SEGMENT_SIZE 4096
+#define KILO_SYNTAX_LOOKBACK 16
+// Background buffers drop what they can rebuild after this long (ms)
+#define KILO_BUFFER_COMPACT 2000
+// Smallest view a split may leave
+#define KILO_VIEW_MIN_ROWS 2
+#define KILO_VIEW_MIN_COLS 10
+// Largest message between a client and the daemon, and how long (ms) a
+// client's terminal may keep the daemon waiting
+#define KILO_MESSAGE_MAX (1024 * 1024)
+#define KILO_CLIENT_TIMEOUT 1000
+// Decorations drawn on a single row at most
+#define KILO_DECOR_SPANS 8
+// Widths soft wrap keeps line counts for, one per view that differs
+#define KILO_WRAP_WIDTHS 4
 
 
 int editorCxToRx(erow *row, int cx);
 
+int editorRowWidth(erow *row);
+
+int editorRowWide(erow *row);
+
 int editorRxToCx(erow *row, int rx);
 
+int editorRxToRender(erow *row, int rx, int *start);
+
+int editorRenderToCx(erow *row, int ri);
+
 void editorUpdateRow(erow *row);
 
 void editorInsertRow(int at, char *s, size_t len);
 
 void editorFreeRow(erow *row);
 
+void editorFreeRows(void);
+
 void editorDelRow(int at);
 
 void editorRowInsertChar(erow *row, int at, int c);
@@ -27,6 +68,8 @@ void editorRowAppendString(erow *row, char *s, size_t len);
 
 void editorRowDelChar(erow *row, int at);
 
+void editorRowTruncate(erow *row, int len);
+
 void editorInsertChar(int c);
 
 void editorInsertNewLine(void);
@@ -39,4 +82,6 @@ void editorFind(void);
 
 void editorMoveCursor(int key);
 
+void editorEnforceMemBudget(void);
+
 #endif
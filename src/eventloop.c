@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "draw.h"
+#include "eventloop.h"
+
+struct eventSource {
+    eventHandler handler;
+    void *arg;
+};
+
+struct eventTimer {
+    void (*callback)(void *);
+    void *arg;
+};
+
+struct postedEvent {
+    void (*callback)(void *);
+    void *arg;
+    struct postedEvent *next;
+};
+
+static int epoll_fd = -1;
+static struct eventSource *sources = NULL;
+static int num_sources = 0;
+static int redraw_pending = 0;
+
+static int signal_fd = -1;
+static sigset_t signal_mask;
+static void (*signal_handlers[NSIG])(int);
+
+static int post_fd = -1;
+static pthread_mutex_t post_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct postedEvent *post_head = NULL;
+static struct postedEvent *post_tail = NULL;
+
+/*** file descriptors ***/
+void eventLoopAddFd(int fd, eventHandler handler, void *arg) {
+    if (epoll_fd == -1) eventLoopInit();
+    if (fd >= num_sources) {
+        int n = fd + 16;
+        sources = realloc(sources, sizeof(struct eventSource) * n);
+        memset(&sources[num_sources], 0, sizeof(struct eventSource) * (n - num_sources));
+        num_sources = n;
+    }
+    sources[fd].handler = handler;
+    sources[fd].arg = arg;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) die("epoll_ctl");
+}
+
+void eventLoopRemoveFd(int fd) {
+    if (fd < 0 || fd >= num_sources) return;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    sources[fd].handler = NULL;
+    sources[fd].arg = NULL;
+}
+
+/*** timers ***/
+static void timerHandler(int fd, void *arg) {
+    struct eventTimer *timer = arg;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+    timer->callback(timer->arg);
+}
+
+int eventLoopAddTimer(void (*callback)(void *), void *arg) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) die("timerfd_create");
+    struct eventTimer *timer = malloc(sizeof(struct eventTimer));
+    timer->callback = callback;
+    timer->arg = arg;
+    eventLoopAddFd(fd, timerHandler, timer);
+    return fd;
+}
+
+// Fire `ms` from now, then every `interval_ms` if that is non-zero.
+// Arming an armed timer restarts it; ms == 0 disarms it.
+void eventLoopArmTimer(int timer, int ms, int interval_ms) {
+    struct itimerspec its;
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    timerfd_settime(timer, 0, &its, NULL);
+}
+
+void eventLoopRemoveTimer(int timer) {
+    if (timer < 0 || timer >= num_sources) return;
+    free(sources[timer].arg);
+    eventLoopRemoveFd(timer);
+    close(timer);
+}
+
+/*** signals ***/
+static void signalHandler(int fd, void *arg) {
+    (void)arg;
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        int signo = info.ssi_signo;
+        if (signo < NSIG && signal_handlers[signo]) signal_handlers[signo](signo);
+    }
+}
+
+void eventLoopAddSignal(int signo, void (*callback)(int)) {
+    if (epoll_fd == -1) eventLoopInit();
+    signal_handlers[signo] = callback;
+    sigaddset(&signal_mask, signo);
+    // The signal is only ever delivered through the signalfd
+    if (sigprocmask(SIG_BLOCK, &signal_mask, NULL) == -1) die("sigprocmask");
+    int fd = signalfd(signal_fd, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) die("signalfd");
+    if (signal_fd == -1) {
+        signal_fd = fd;
+        eventLoopAddFd(signal_fd, signalHandler, NULL);
+    }
+}
+
+/*** posted callbacks ***/
+static void postHandler(int fd, void *arg) {
+    (void)arg;
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) return;
+
+    pthread_mutex_lock(&post_lock);
+    struct postedEvent *ev = post_head;
+    post_head = post_tail = NULL;
+    pthread_mutex_unlock(&post_lock);
+
+    while (ev) {
+        struct postedEvent *next = ev->next;
+        ev->callback(ev->arg);
+        free(ev);
+        ev = next;
+    }
+}
+
+// Run `callback` on the UI thread. Safe to call from any thread.
+void eventLoopPost(void (*callback)(void *), void *arg) {
+    struct postedEvent *ev = malloc(sizeof(struct postedEvent));
+    ev->callback = callback;
+    ev->arg = arg;
+    ev->next = NULL;
+
+    pthread_mutex_lock(&post_lock);
+    if (post_tail) post_tail->next = ev;
+    else post_head = ev;
+    post_tail = ev;
+    pthread_mutex_unlock(&post_lock);
+
+    uint64_t one = 1;
+    if (write(post_fd, &one, sizeof(one)) != sizeof(one)) die("eventfd");
+}
+
+/*** redraws ***/
+void eventLoopRequestRedraw(void) {
+    redraw_pending = 1;
+}
+
+void eventLoopFlushRedraw(void) {
+    if (!redraw_pending) return;
+    redraw_pending = 0;
+    editorRefreshScreen();
+}
+
+/*** loop ***/
+void eventLoopInit(void) {
+    if (epoll_fd != -1) return;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) die("epoll_create1");
+    sigemptyset(&signal_mask);
+    post_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (post_fd == -1) die("eventfd");
+    eventLoopAddFd(post_fd, postHandler, NULL);
+}
+
+// Block for up to timeout_ms (-1 for ever) and dispatch whatever became
+// ready. Returns the number of events handled.
+int eventLoopWait(int timeout_ms) {
+    if (epoll_fd == -1) eventLoopInit();
+    struct epoll_event events[16];
+    int n = epoll_wait(epoll_fd, events, 16, timeout_ms);
+    if (n == -1) {
+        if (errno == EINTR) return 0;
+        die("epoll_wait");
+    }
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        // An earlier handler in this batch may have removed the source
+        if (fd < num_sources && sources[fd].handler) {
+            sources[fd].handler(fd, sources[fd].arg);
+        }
+    }
+    return n;
+}
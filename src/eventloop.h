@@ -0,0 +1,36 @@
+#ifndef EVENTLOOP_H_
+#define EVENTLOOP_H_
+
+/* epoll based main loop.
+ *
+ * Everything the editor reacts to is an event on one epoll set: readable
+ * file descriptors (the terminal), timers (timerfd), signals (signalfd)
+ * and callbacks posted by worker threads (eventfd). Handlers run on the
+ * UI thread. Anything that changes the screen asks for a redraw, and
+ * the loop draws once after each batch of events.
+ */
+typedef void (*eventHandler)(int fd, void *arg);
+
+void eventLoopInit(void);
+
+void eventLoopAddFd(int fd, eventHandler handler, void *arg);
+
+void eventLoopRemoveFd(int fd);
+
+int eventLoopAddTimer(void (*callback)(void *), void *arg);
+
+void eventLoopArmTimer(int timer, int ms, int interval_ms);
+
+void eventLoopRemoveTimer(int timer);
+
+void eventLoopAddSignal(int signo, void (*callback)(int));
+
+void eventLoopPost(void (*callback)(void *), void *arg);
+
+void eventLoopRequestRedraw(void);
+
+void eventLoopFlushRedraw(void);
+
+int eventLoopWait(int timeout_ms);
+
+#endif
@@ -0,0 +1,80 @@
+#include <string.h>
+
+#include "fenwick.h"
+#include "memory.h"
+
+static void fenwickReserve(struct fenwick *f, int n) {
+    if (n + 1 <= f->cap) return;
+    f->cap = f->cap ? f->cap : 1024;
+    while (f->cap < n + 1) f->cap *= 2;
+    f->v = memRealloc(MEM_LAYOUT, f->v, sizeof(int) * f->cap);
+    f->t = memRealloc(MEM_LAYOUT, f->t, sizeof(long long) * f->cap);
+}
+
+// Redo the nodes from the first stale value up to node `upto`. Each is its
+// value plus the nodes just below it, which makes a whole build linear.
+// Nothing in a node depends on those after it, so a prefix sum only needs
+// the nodes up to where it stops: right after an edit that is next to none.
+static void fenwickSync(struct fenwick *f, int upto) {
+    for (int i = f->valid + 1; i <= upto; i++) {
+        f->t[i] = f->v[i - 1];
+        for (int step = 1; step < (i & -i); step *= 2) f->t[i] += f->t[i - step];
+    }
+    if (upto > f->valid) f->valid = upto;
+}
+
+void fenwickInsert(struct fenwick *f, int at, int value) {
+    fenwickReserve(f, f->n + 1);
+    memmove(&f->v[at + 1], &f->v[at], sizeof(int) * (f->n - at));
+    f->v[at] = value;
+    f->n++;
+    if (at < f->valid) f->valid = at;
+}
+
+void fenwickDelete(struct fenwick *f, int at) {
+    memmove(&f->v[at], &f->v[at + 1], sizeof(int) * (f->n - at - 1));
+    f->n--;
+    if (at < f->valid) f->valid = at;
+}
+
+void fenwickSet(struct fenwick *f, int i, int value) {
+    long long delta = value - f->v[i];
+    f->v[i] = value;
+    // Nodes past valid are redone anyway
+    if (i >= f->valid) return;
+    for (i++; i <= f->valid; i += i & -i) f->t[i] += delta;
+}
+
+int fenwickGet(const struct fenwick *f, int i) {
+    return f->v[i];
+}
+
+// Sum of the first i values
+long long fenwickPrefix(struct fenwick *f, int i) {
+    long long sum = 0;
+    if (i > f->n) i = f->n;
+    fenwickSync(f, i);
+    for (; i > 0; i -= i & -i) sum += f->t[i];
+    return sum;
+}
+
+// The value a running total of `total` falls in: the largest i with
+// fenwickPrefix(i) <= total. n once total reaches the sum of all.
+int fenwickFind(struct fenwick *f, long long total) {
+    int step = 1, at = 0;
+    fenwickSync(f, f->n);
+    while (step * 2 <= f->n) step *= 2;
+    for (; step > 0; step /= 2) {
+        if (at + step <= f->n && f->t[at + step] <= total) {
+            at += step;
+            total -= f->t[at];
+        }
+    }
+    return at;
+}
+
+void fenwickFree(struct fenwick *f) {
+    memFree(MEM_LAYOUT, f->v);
+    memFree(MEM_LAYOUT, f->t);
+    memset(f, 0, sizeof(struct fenwick));
+}
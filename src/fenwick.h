@@ -0,0 +1,35 @@
+#ifndef FENWICK_H_
+#define FENWICK_H_
+
+/* Fenwick (binary indexed) tree over a run of non-negative values, one per
+ * row: prefix sums, point updates and finding the row a running total
+ * falls in, all in O(log n). Rows coming or going shift the values after
+ * them, so the tree is rebuilt from there on as far as the next lookup
+ * reaches, in time linear in the rows it covers: appending is O(log n), an
+ * insert at the top O(n) for a lookup past it.
+ */
+struct fenwick {
+    int *v;
+    // 1-based, t[i] sums v over (i - lowbit(i), i]
+    long long *t;
+    int n;
+    int cap;
+    // t is right for the values before this one
+    int valid;
+};
+
+void fenwickInsert(struct fenwick *f, int at, int value);
+
+void fenwickDelete(struct fenwick *f, int at);
+
+void fenwickSet(struct fenwick *f, int i, int value);
+
+int fenwickGet(const struct fenwick *f, int i);
+
+long long fenwickPrefix(struct fenwick *f, int i);
+
+int fenwickFind(struct fenwick *f, long long total);
+
+void fenwickFree(struct fenwick *f);
+
+#endif
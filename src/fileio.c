@@ -1,7 +1,18 @@
+#define _GNU_SOURCE
+
 #include "userinput.h"
+#include "buffer.h"
+#include "decor.h"
 #include "draw.h"
 #include "editor_ops.h"
+#include "eventloop.h"
 #include "fileio.h"
+#include "follow.h"
+#include "journal.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "profile.h"
+#include "reload.h"
 #include "terminal.h"
 #include "syntax.h"
 
@@ -23,24 +34,71 @@ char * editorRowsToString(int *len) {
     return buf;
 }
 
+// Rows arrive in the background, see loader.c
 void editorOpen(char *filename) {
-    FILE * fp = fopen(filename, "r");
+    editorLoadCancel();
+    editorFollowStop();
+    editorWatchStop();
+    editorSavedInstall(NULL);
+    // Decorations point at rows of the old file
+    decorFree();
+    journalClose(E.journal);
+    E.journal = NULL;
+    if (E.numrows > 0) editorFreeRows();
+    free(E.filename);
     E.filename = strdup(filename);
     editorSelectSyntaxHilighting();
-    char * line = NULL;
-    size_t linecap = 0;
-    ssize_t linelen;
-    // Read file by line
-    while((linelen = getline(&line, &linecap, fp)) != -1) {
-        // Strip return
-        while (linelen > 0 && (line[linelen - 1] == '\n' ||
-                    line[linelen - 1] == '\r'))
-            linelen--;
-        editorInsertRow(E.numrows, line, linelen);
-    }
-    free(line);
-    fclose(fp);
     E.dirty = 0;
+    E.file_bytes = 0;
+
+    // A crashed session left its edits behind
+    int recovered = journalRecover(filename);
+    E.journal = journalOpen(filename);
+    if (recovered != -1) {
+        // What is on disk, not what was recovered, is the saved state
+        editorSavedFromFile(filename);
+        editorWatchStart();
+        journalCheckpoint(E.journal);
+        editorSetStatusMessage("Recovered unsaved changes to %s (%d edits in the journal)",
+                filename, recovered);
+        return;
+    }
+    // A file that doesn't exist yet is created on save
+    if (editorLoadStart(filename) == -1 && errno != ENOENT) {
+        editorSetStatusMessage("Can't open %s: %s", filename, strerror(errno));
+    }
+    editorWatchStart();
+}
+
+struct saveRequest {
+    // The buffer saved, which may not be current when the save lands
+    int buffer;
+    int dirty;
+    struct savedLines *saved;
+};
+
+// The writer thread is done with a save
+static void editorSaveDone(int err, long long bytes, void *arg) {
+    struct saveRequest *req = arg;
+    int prev = bufferEnterId(req->buffer);
+    if (prev == -1) {
+        // Closed while it was being written
+        editorSavedFree(req->saved);
+    } else if (err) {
+        editorWatchSaveEnd(0);
+        editorSetStatusMessage("Can't save! I/O error: %s", strerror(err));
+        editorSavedFree(req->saved);
+    } else {
+        editorWatchSaveEnd(1);
+        // Edits made while writing keep the buffer modified
+        if (E.dirty == req->dirty) E.dirty = 0;
+        editorSavedInstall(req->saved);
+        lineIndexSaved();
+        editorSetStatusMessage("%lld bytes written to disk", bytes);
+        eventLoopRequestRedraw();
+    }
+    bufferLeave(prev);
+    free(req);
 }
 
 void editorSave(void) {
@@ -55,22 +113,17 @@ void editorSave(void) {
     
 
     if (E.filename == NULL) return;
-    int len;
-    char *s = editorRowsToString(&len);
-    int fd = open(E.filename, O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        if (ftruncate(fd, len) != -1) {
-            if (write(fd, s, len) == len) {
-                close(fd);
-                free(s);
-                E.dirty = 0;
-                editorSetStatusMessage("%d bytes written to disk", len);
-                return;
-            }
-        }
-        close(fd);
-    }
-    free(s);
-    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
+    // Saving half a file would truncate it
+    editorLoadFinish();
+    // Time handing the write off, not the user typing a file name
+    PROFILE_BEGIN(PROF_SAVE);
+    if (!E.journal) E.journal = journalOpen(E.filename);
+    struct saveRequest *req = malloc(sizeof(struct saveRequest));
+    req->buffer = bufferId();
+    req->dirty = E.dirty;
+    req->saved = editorSavedCapture();
+    editorWatchSaveBegin();
+    journalSave(E.journal, E.filename, editorSaveDone, req);
+    PROFILE_END(PROF_SAVE);
 }
 
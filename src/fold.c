@@ -0,0 +1,287 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "terminal.h"
+#include "editor_ops.h"
+#include "fold.h"
+#include "loader.h"
+#include "memory.h"
+#include "syntax.h"
+#include "treap.h"
+#include "wrap.h"
+
+struct foldNode {
+    // Keyed by its first row, which stays on screen
+    struct treapNode node;
+    // Rows it hides after that, down to its last
+    int len;
+    // Rows the subtree hides
+    int hidden;
+};
+
+/*** treap ***/
+static struct foldNode *foldOf(struct treapNode *n) {
+    return (struct foldNode *)n;
+}
+
+static int foldEndOf(struct treapNode *n) {
+    return n->row + foldOf(n)->len;
+}
+
+static int foldHiddenIn(struct treapNode *n) {
+    return n ? foldOf(n)->hidden : 0;
+}
+
+static void foldPull(struct treapNode *n) {
+    foldOf(n)->hidden = foldOf(n)->len + foldHiddenIn(n->left) + foldHiddenIn(n->right);
+}
+
+// Move the end of the last fold of n by delta if it reaches row, and drop
+// it if that leaves nothing hidden. Returns what is left of n.
+static struct treapNode *foldTrimLast(struct treapNode *n, int row, int delta) {
+    if (!n) return NULL;
+    treapPush(n);
+    if (n->right) {
+        n->right = foldTrimLast(n->right, row, delta);
+        foldPull(n);
+        return n;
+    }
+    if (foldEndOf(n) >= row) foldOf(n)->len += delta;
+    if (foldOf(n)->len <= 0) return treapDropLast(n, foldPull);
+    foldPull(n);
+    return n;
+}
+
+// The fold row is in, header or hidden
+static struct treapNode *foldFind(int row) {
+    struct treapNode *n = E.folds, *best = NULL;
+    while (n) {
+        treapPush(n);
+        if (n->row <= row) {
+            best = n;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return best && row <= foldEndOf(best) ? best : NULL;
+}
+
+// Recount the screen lines of rows that were shown or hidden
+static void foldRewrap(int start, int end) {
+    for (int i = start; i <= end && i < E.numrows; i++) wrapRowChanged(&E.row[i]);
+}
+
+/*** lookups ***/
+// The screen line row is on, counting from the top of the file. A hidden
+// row is on the line of its fold.
+int foldLineOf(int row) {
+    struct treapNode *n = E.folds;
+    int hidden = 0;
+    while (n) {
+        treapPush(n);
+        if (n->row < row) {
+            hidden += foldHiddenIn(n->left) + (foldEndOf(n) < row ? foldEndOf(n) : row) - n->row;
+            n = n->right;
+        } else {
+            n = n->left;
+        }
+    }
+    return row - hidden;
+}
+
+// The row shown on screen line `line`. Past the end, rows go on one a line.
+int foldRowAt(int line) {
+    struct treapNode *n = E.folds;
+    int hidden = 0;
+    while (n) {
+        treapPush(n);
+        int before = hidden + foldHiddenIn(n->left);
+        if (line <= n->row - before) {
+            n = n->left;
+        } else {
+            hidden = before + foldOf(n)->len;
+            n = n->right;
+        }
+    }
+    return line + hidden;
+}
+
+// The row a hidden row shows as, else row
+int foldStart(int row) {
+    struct treapNode *f = foldFind(row);
+    return f ? f->row : row;
+}
+
+// The last row folded into row, else row
+int foldEnd(int row) {
+    struct treapNode *f = foldFind(row);
+    return f ? foldEndOf(f) : row;
+}
+
+int foldHidden(int row) {
+    if (!E.folds) return 0;
+    struct treapNode *f = foldFind(row);
+    return f && row > f->row;
+}
+
+/*** blocks ***/
+static int foldIsBlank(erow *row) {
+    for (int i = 0; i < row->size; i++) {
+        if (row->chars[i] != ' ' && row->chars[i] != '\t') return 0;
+    }
+    return 1;
+}
+
+static int foldIndent(erow *row) {
+    int col = 0;
+    for (int i = 0; i < row->size; i++) {
+        if (row->chars[i] == '\t') col += KILO_TAB_STOP - col % KILO_TAB_STOP;
+        else if (row->chars[i] == ' ') col++;
+        else break;
+    }
+    return col;
+}
+
+// Opening braces row leaves open, less those it closes, braces in strings
+// and comments aside
+static int foldBraces(erow *row, int depth, int *closed) {
+    if (E.syntax) editorRowEnsureHl(row);
+    for (int i = 0; i < row->rsize; i++) {
+        char c = row->render[i];
+        if (c != '{' && c != '}') continue;
+        if (E.syntax && (row->hl[i] == HL_STRING || row->hl[i] == HL_COMMENT ||
+                row->hl[i] == HL_MLCOMMENT)) continue;
+        if (c == '{') {
+            depth++;
+        } else if (depth > 0 && --depth == 0) {
+            if (closed) *closed = 1;
+            return 0;
+        }
+    }
+    return depth;
+}
+
+// Last row of the block opened on row at: a brace it leaves open and the
+// row that closes it, or the rows after it indented deeper. -1 if none.
+// Rows still on their way from disk are waited for.
+static int foldBlock(int at) {
+    int depth = foldBraces(&E.row[at], 0, NULL);
+    if (depth > 0) {
+        for (int i = at + 1;; i++) {
+            editorLoadWaitRow(i);
+            if (i >= E.numrows) break;
+            int closed = 0;
+            depth = foldBraces(&E.row[i], depth, &closed);
+            if (closed) return i;
+        }
+        return -1;
+    }
+    if (foldIsBlank(&E.row[at])) return -1;
+    int indent = foldIndent(&E.row[at]), end = -1;
+    for (int i = at + 1;; i++) {
+        editorLoadWaitRow(i);
+        if (i >= E.numrows) break;
+        if (foldIsBlank(&E.row[i])) continue;
+        if (foldIndent(&E.row[i]) <= indent) break;
+        end = i;
+    }
+    return end;
+}
+
+/*** folding ***/
+static void foldAdd(int start, int end) {
+    struct treapNode *left, *mid, *right, *last;
+    treapSplit(E.folds, start, &left, &right, foldPull);
+    // Folds it overlaps become part of it
+    last = treapLast(left);
+    if (last && foldEndOf(last) >= start) {
+        start = last->row;
+        if (foldEndOf(last) > end) end = foldEndOf(last);
+        left = treapDropLast(left, foldPull);
+    }
+    treapSplit(right, end + 1, &mid, &right, foldPull);
+    last = treapLast(mid);
+    if (last && foldEndOf(last) > end) end = foldEndOf(last);
+    treapFree(mid);
+
+    struct foldNode *f = memAlloc(MEM_LAYOUT, sizeof(struct foldNode));
+    treapInit(&f->node, start);
+    f->len = end - start;
+    foldPull(&f->node);
+    E.folds = treapMerge(treapMerge(left, &f->node, foldPull), right, foldPull);
+    foldRewrap(start + 1, end);
+    E.version++;
+}
+
+// Close the block at row, or the innermost one around it. Returns the
+// first row of the fold, or -1 if there is no block there.
+int foldClose(int row) {
+    if (row >= E.numrows) return -1;
+    int at = row;
+    for (;;) {
+        int end = foldBlock(at);
+        if (end >= row) {
+            foldAdd(at, end);
+            return at;
+        }
+        // Up to the row the block around this one starts on
+        int indent = foldIsBlank(&E.row[at]) ? INT_MAX : foldIndent(&E.row[at]);
+        do {
+            at--;
+        } while (at >= 0 && (foldIsBlank(&E.row[at]) || foldIndent(&E.row[at]) >= indent));
+        if (at < 0) return -1;
+    }
+}
+
+// Open the fold row is in
+void foldOpen(int row) {
+    struct treapNode *f = foldFind(row), *left, *mid, *right;
+    if (!f) return;
+    int start = f->row, end = foldEndOf(f);
+    treapSplit(E.folds, start, &left, &right, foldPull);
+    treapSplit(right, start + 1, &mid, &right, foldPull);
+    treapFree(mid);
+    E.folds = treapMerge(left, right, foldPull);
+    foldRewrap(start + 1, end);
+    E.version++;
+}
+
+void foldOpenAll(void) {
+    if (!E.folds) return;
+    foldFree();
+    wrapFree();
+    E.version++;
+}
+
+void foldFree(void) {
+    treapFree(E.folds);
+    E.folds = NULL;
+}
+
+/*** edits ***/
+// E.row[at] is new: a row added inside a fold stays hidden
+void foldInsertRow(int at) {
+    if (!E.folds) return;
+    struct treapNode *left, *right;
+    treapSplit(E.folds, at, &left, &right, foldPull);
+    treapMove(right, 1);
+    left = foldTrimLast(left, at, 1);
+    E.folds = treapMerge(left, right, foldPull);
+}
+
+// E.row[at] is about to go. Taking away the first row of a fold opens it.
+void foldDelRow(int at) {
+    if (!E.folds) return;
+    struct treapNode *left, *mid, *right;
+    treapSplit(E.folds, at, &left, &right, foldPull);
+    treapSplit(right, at + 1, &mid, &right, foldPull);
+    if (mid) {
+        treapFree(mid);
+        // Its rows show again
+        wrapFree();
+    }
+    treapMove(right, -1);
+    left = foldTrimLast(left, at, -1);
+    E.folds = treapMerge(left, right, foldPull);
+}
@@ -0,0 +1,38 @@
+#ifndef FOLD_H_
+#define FOLD_H_
+
+#include "terminal.h"
+
+/* Code folding.
+ *
+ * A closed fold keeps its first row on screen and hides the rest, down to
+ * its last. Folds are kept apart, closing one over others takes them in,
+ * so they sit in a treap ordered by first row, each node carrying the rows
+ * its subtree hides. Mapping rows to screen lines and back, and finding the
+ * fold a row is in, is then a walk down the tree, O(log n) however many
+ * rows are hidden. Rows coming or going move every fold after them, which
+ * is a split and a shift left for the walks down to pass on.
+ */
+int foldLineOf(int row);
+
+int foldRowAt(int line);
+
+int foldStart(int row);
+
+int foldEnd(int row);
+
+int foldHidden(int row);
+
+int foldClose(int row);
+
+void foldOpen(int row);
+
+void foldOpenAll(void);
+
+void foldInsertRow(int at);
+
+void foldDelRow(int at);
+
+void foldFree(void);
+
+#endif
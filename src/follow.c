@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "buffer.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "follow.h"
+#include "journal.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "reload.h"
+
+struct editorFollow {
+    char *path;
+    int fd;
+    dev_t dev;
+    ino_t ino;
+    // Next byte to read, -1 until the initial load is done
+    off_t offset;
+    // The last row is still waiting for its newline
+    int partial;
+    int inotify_fd;
+    int file_wd;
+    int retry_timer;
+};
+
+/*** reading ***/
+static void editorFollowAppend(struct editorFollow *f, char *s, size_t len) {
+    if (f->partial && E.numrows > 0) {
+        char *nl = memchr(s, '\n', len);
+        size_t n = nl ? (size_t)(nl - s) : len;
+        size_t keep = n;
+        if (nl && keep > 0 && s[keep - 1] == '\r') keep--;
+        int dirty = E.dirty;
+        journalSuspend();
+        erow *row = &E.row[E.numrows - 1];
+        editorRowAppendString(row, s, keep);
+        if (nl) {
+            row->eol = n - keep + 1;
+            lineIndexRowChanged(row);
+        }
+        editorSavedSetLine(row->idx, row->chars, row->size);
+        journalResume();
+        E.dirty = dirty;
+        f->partial = nl == NULL;
+        if (!nl) return;
+        s += n + 1;
+        len -= n + 1;
+    }
+    if (len == 0) return;
+    editorLoadAppend(s, len);
+    f->partial = s[len - 1] != '\n';
+}
+
+// Read everything past the offset. Returns whether rows changed.
+static int editorFollowRead(struct editorFollow *f) {
+    struct stat st;
+    if (fstat(f->fd, &st) == -1) return 0;
+    if (st.st_size < f->offset) {
+        editorSetStatusMessage("%s was truncated", f->path);
+        f->offset = 0;
+        f->partial = 0;
+    }
+    int changed = 0;
+    char *buf = malloc(KILO_LOAD_CHUNK);
+    ssize_t n;
+    while ((n = pread(f->fd, buf, KILO_LOAD_CHUNK, f->offset)) > 0) {
+        f->offset += n;
+        editorFollowAppend(f, buf, n);
+        changed = 1;
+    }
+    free(buf);
+    E.file_bytes = f->offset;
+    return changed;
+}
+
+static int editorFollowOpen(struct editorFollow *f) {
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (f->fd != -1) close(f->fd);
+    f->fd = fd;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    if (f->file_wd != -1) inotify_rm_watch(f->inotify_fd, f->file_wd);
+    f->file_wd = inotify_add_watch(f->inotify_fd, f->path,
+            IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+    return 0;
+}
+
+static void editorFollowPoll(struct editorFollow *f) {
+    // The loader reads up to where following starts
+    if (E.loader) {
+        eventLoopArmTimer(f->retry_timer, KILO_FOLLOW_RETRY, 0);
+        return;
+    }
+    if (f->offset == -1) {
+        char last;
+        f->offset = E.file_bytes;
+        f->partial = f->offset > 0 && pread(f->fd, &last, 1, f->offset - 1) == 1 && last != '\n';
+    }
+
+    // Only chase new rows when the last one is on screen
+    int at_end = E.rowoff + E.screenrows >= E.numrows;
+    int changed = editorFollowRead(f);
+
+    struct stat st;
+    if (stat(f->path, &st) == 0 && (st.st_dev != f->dev || st.st_ino != f->ino)) {
+        // Rotated: the old file is drained, carry on with the new one
+        if (editorFollowOpen(f) == 0) {
+            f->offset = 0;
+            f->partial = 0;
+            changed |= editorFollowRead(f);
+            editorSetStatusMessage("%s was replaced, following the new file", f->path);
+        }
+    }
+
+    if (changed && at_end && E.numrows > 0) {
+        E.cy = E.numrows - 1;
+        E.cx = 0;
+        E.cursor_pos = 0;
+    }
+    if (changed) eventLoopRequestRedraw();
+}
+
+static void editorFollowRetry(void *arg) {
+    int prev = bufferEnter(offsetof(struct editorConfig, follow), arg);
+    if (prev == -1) return;
+    editorFollowPoll(arg);
+    bufferLeave(prev);
+}
+
+static void editorFollowEvent(int fd, void *arg) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    // What changed doesn't matter, the file is looked at either way
+    while (read(fd, buf, sizeof(buf)) > 0);
+    editorFollowRetry(arg);
+}
+
+/*** follow mode ***/
+int editorFollowStart(void) {
+    if (E.follow) return 0;
+    if (!E.filename) return -1;
+    struct editorFollow *f = calloc(1, sizeof(struct editorFollow));
+    f->path = strdup(E.filename);
+    f->fd = -1;
+    f->file_wd = -1;
+    f->offset = -1;
+    f->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f->inotify_fd == -1 || editorFollowOpen(f) == -1) {
+        int err = errno;
+        if (f->inotify_fd != -1) close(f->inotify_fd);
+        free(f->path);
+        free(f);
+        errno = err;
+        return -1;
+    }
+    // Rotation shows up as a new file in the directory
+    char *dir = strdup(f->path);
+    inotify_add_watch(f->inotify_fd, dirname(dir), IN_CREATE | IN_MOVED_TO);
+    free(dir);
+
+    E.follow = f;
+    f->retry_timer = eventLoopAddTimer(editorFollowRetry, f);
+    eventLoopAddFd(f->inotify_fd, editorFollowEvent, f);
+    editorFollowPoll(f);
+    return 0;
+}
+
+void editorFollowStop(void) {
+    struct editorFollow *f = E.follow;
+    if (!f) return;
+    E.follow = NULL;
+    eventLoopRemoveFd(f->inotify_fd);
+    eventLoopRemoveTimer(f->retry_timer);
+    close(f->inotify_fd);
+    close(f->fd);
+    free(f->path);
+    free(f);
+}
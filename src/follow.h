@@ -0,0 +1,19 @@
+#ifndef FOLLOW_H_
+#define FOLLOW_H_
+
+/* Follow mode for growing files.
+ *
+ * inotify watches the file and its directory. Whenever either changes,
+ * the bytes past the last known offset are read and appended as rows, and
+ * the view follows them if it was showing the last row. A file that
+ * shrinks was truncated and is read again from the start; a different
+ * file under the same name was rotated and gets reopened. Either way the
+ * rows already in the buffer stay.
+ */
+struct editorFollow;
+
+int editorFollowStart(void);
+
+void editorFollowStop(void);
+
+#endif
@@ -0,0 +1,571 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "buffer.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "journal.h"
+#include "loader.h"
+#include "snapshot.h"
+
+// op, row, at and length ahead of the bytes, checksum after them
+#define JOURNAL_RECORD_HEAD 13
+#define JOURNAL_RECORD_TAIL 4
+
+struct journal {
+    char *path;
+    // Writer thread only
+    int fd;
+    // UI thread only
+    long long gen;
+    const char *base;
+    struct abuf pending;
+    int records;
+    int suspended;
+    int sync_timer;
+    int autosave_timer;
+};
+
+enum journalJobType {
+    JOB_APPEND,
+    JOB_CHECKPOINT,
+    JOB_SAVE,
+    JOB_REBASE,
+    JOB_CLOSE,
+};
+
+struct journalJob {
+    enum journalJobType type;
+    struct journal *j;
+    char *data;
+    int len;
+    long long gen;
+    const char *base;
+    struct snapNode *snap;
+    char *path;
+    void (*done)(int err, long long bytes, void *arg);
+    void *arg;
+    struct journalJob *next;
+};
+
+struct journalDone {
+    void (*done)(int err, long long bytes, void *arg);
+    void *arg;
+    int err;
+    long long bytes;
+};
+
+static pthread_t writer_thread;
+static int writer_started = 0;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static struct journalJob *job_head = NULL;
+static struct journalJob *job_tail = NULL;
+// A job is taken off the queue but not finished yet
+static int writer_busy = 0;
+
+/*** files ***/
+static char *journalPath(const char *path, const char *suffix) {
+    size_t len = strlen(path) + strlen(suffix) + 1;
+    char *p = malloc(len);
+    snprintf(p, len, "%s%s", path, suffix);
+    return p;
+}
+
+static char *journalReadFile(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return NULL;
+    size_t cap = 65536;
+    char *buf = malloc(cap);
+    *len = 0;
+    while (1) {
+        if (*len == cap) buf = realloc(buf, cap *= 2);
+        ssize_t n = read(fd, buf + *len, cap - *len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        *len += n;
+    }
+    close(fd);
+    return buf;
+}
+
+// Generation from a "<magic> <gen> ..." header line, or -1
+static long long journalHeader(const char *buf, size_t len, const char *magic,
+        char *base, size_t baselen, size_t *body) {
+    const char *nl = buf ? memchr(buf, '\n', len) : NULL;
+    if (!nl) return -1;
+    char line[128];
+    snprintf(line, sizeof(line), "%.*s", (int)(nl - buf), buf);
+    char word[32];
+    char rest[32] = "";
+    long long gen;
+    if (sscanf(line, "%31s %lld %31s", word, &gen, rest) < 2 || strcmp(word, magic)) return -1;
+    if (base) snprintf(base, baselen, "%s", rest);
+    *body = nl - buf + 1;
+    return gen;
+}
+
+static uint32_t journalChecksum(const char *s, size_t len) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*** writer thread ***/
+static int writerWriteAll(int fd, const char *s, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, s, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        s += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Make a rename inside the file's directory durable
+static void writerSyncDir(const char *path) {
+    char *copy = strdup(path);
+    int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+    free(copy);
+}
+
+// Atomically replace "<path><suffix>" with header followed by the
+// snapshot. Returns the open file, or -1.
+static int writerReplace(const char *path, const char *suffix, const char *header,
+        struct snapNode *snap) {
+    char *final = journalPath(path, suffix);
+    char *tmp = journalPath(final, ".tmp");
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    int code = fd == -1 ? -1 : 0;
+    if (code == 0) code = writerWriteAll(fd, header, strlen(header));
+    if (code == 0 && snap) code = snapshotWrite(snap, fd);
+    if (code == 0) code = fsync(fd);
+    if (code == 0) code = rename(tmp, final);
+    if (code == 0) writerSyncDir(final);
+    if (code == -1 && fd != -1) {
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        fd = -1;
+    }
+    free(tmp);
+    free(final);
+    return fd;
+}
+
+static int writerStartJournal(struct journal *j, long long gen, const char *base) {
+    char header[64];
+    snprintf(header, sizeof(header), "kilo-journal %lld %s\n", gen, base);
+    if (j->fd != -1) close(j->fd);
+    j->fd = writerReplace(j->path, ".journal", header, NULL);
+    return j->fd == -1 ? -1 : 0;
+}
+
+static int writerCheckpoint(struct journalJob *job) {
+    char header[64];
+    snprintf(header, sizeof(header), "kilo-autosave %lld\n", job->gen);
+    int fd = writerReplace(job->j->path, ".autosave", header, job->snap);
+    if (fd == -1) return -1;
+    close(fd);
+    return writerStartJournal(job->j, job->gen, "autosave");
+}
+
+// The file on disk is the new base, what came before is history
+static int writerRebase(struct journalJob *job) {
+    char *autosave = journalPath(job->j->path, ".autosave");
+    int code = writerStartJournal(job->j, job->gen, "file");
+    unlink(autosave);
+    free(autosave);
+    return code;
+}
+
+static int writerSave(struct journalJob *job) {
+    int fd = open(job->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) return -1;
+    int code = ftruncate(fd, snapshotSize(job->snap));
+    if (code == 0) code = snapshotWrite(job->snap, fd);
+    if (code == 0) code = fsync(fd);
+    int err = errno;
+    close(fd);
+    errno = err;
+    if (code == -1) return -1;
+    writerRebase(job);
+    return 0;
+}
+
+static void writerClose(struct journal *j) {
+    if (j->fd != -1) close(j->fd);
+    char *journal = journalPath(j->path, ".journal");
+    char *autosave = journalPath(j->path, ".autosave");
+    unlink(journal);
+    unlink(autosave);
+    free(journal);
+    free(autosave);
+    free(j->path);
+    free(j);
+}
+
+// Runs on the UI thread once a job with a callback is done
+static void journalDoneCallback(void *arg) {
+    struct journalDone *d = arg;
+    if (d->done) {
+        d->done(d->err, d->bytes, d->arg);
+    } else {
+        editorSetStatusMessage("Journal write failed: %s", strerror(d->err));
+    }
+    free(d);
+}
+
+static void writerRun(struct journalJob *job) {
+    int code = 0;
+    switch (job->type) {
+        case JOB_APPEND:
+            if (job->j->fd == -1) code = writerStartJournal(job->j, job->gen, job->base);
+            if (code == 0) code = writerWriteAll(job->j->fd, job->data, job->len);
+            if (code == 0) code = fdatasync(job->j->fd);
+            break;
+        case JOB_CHECKPOINT:
+            code = writerCheckpoint(job);
+            break;
+        case JOB_SAVE:
+            code = writerSave(job);
+            break;
+        case JOB_REBASE:
+            code = writerRebase(job);
+            break;
+        case JOB_CLOSE:
+            writerClose(job->j);
+            break;
+    }
+    if (job->done || code == -1) {
+        struct journalDone *d = malloc(sizeof(struct journalDone));
+        d->done = job->done;
+        d->arg = job->arg;
+        d->err = code == -1 ? errno : 0;
+        d->bytes = job->snap ? snapshotSize(job->snap) : 0;
+        eventLoopPost(journalDoneCallback, d);
+    }
+}
+
+static void *writerThread(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&writer_lock);
+        while (!job_head) pthread_cond_wait(&writer_cond, &writer_lock);
+        struct journalJob *job = job_head;
+        job_head = job->next;
+        if (!job_head) job_tail = NULL;
+        writer_busy = 1;
+        pthread_mutex_unlock(&writer_lock);
+
+        writerRun(job);
+        snapshotRelease(job->snap);
+        free(job->data);
+        free(job->path);
+        free(job);
+
+        pthread_mutex_lock(&writer_lock);
+        writer_busy = 0;
+        pthread_cond_broadcast(&writer_cond);
+        pthread_mutex_unlock(&writer_lock);
+    }
+    return NULL;
+}
+
+/*** ui thread ***/
+static void journalQueue(struct journalJob *job) {
+    pthread_mutex_lock(&writer_lock);
+    if (!writer_started) {
+        // Posts completions, so the loop has to exist first
+        eventLoopInit();
+        if (pthread_create(&writer_thread, NULL, writerThread, NULL) != 0) die("pthread_create");
+        writer_started = 1;
+    }
+    job->next = NULL;
+    if (job_tail) job_tail->next = job;
+    else job_head = job;
+    job_tail = job;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+static struct journalJob *journalJobNew(enum journalJobType type, struct journal *j) {
+    struct journalJob *job = calloc(1, sizeof(struct journalJob));
+    job->type = type;
+    job->j = j;
+    job->gen = j->gen;
+    job->base = j->base;
+    return job;
+}
+
+// Hand the records batched so far to the writer
+static void journalFlush(struct journal *j) {
+    if (j->pending.len == 0) return;
+    struct journalJob *job = journalJobNew(JOB_APPEND, j);
+    job->data = j->pending.b;
+    job->len = j->pending.len;
+    j->pending.b = NULL;
+    j->pending.len = 0;
+    journalQueue(job);
+}
+
+static void journalSyncTimer(void *arg) {
+    journalFlush(arg);
+}
+
+static void journalAutosaveTimer(void *arg) {
+    struct journal *j = arg;
+    // Snapshots come from E, so the buffer has to be current for this
+    int prev = bufferEnter(offsetof(struct editorConfig, journal), j);
+    if (prev == -1) return;
+    journalCheckpoint(j);
+    bufferLeave(prev);
+}
+
+// Highest generation left behind by earlier sessions
+static long long journalLastGen(const char *path) {
+    long long gen = 0;
+    const char *suffixes[] = {".journal", ".autosave"};
+    const char *magics[] = {"kilo-journal", "kilo-autosave"};
+    for (int i = 0; i < 2; i++) {
+        char *p = journalPath(path, suffixes[i]);
+        int fd = open(p, O_RDONLY | O_CLOEXEC);
+        free(p);
+        if (fd == -1) continue;
+        char buf[128];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        close(fd);
+        size_t body;
+        long long g = journalHeader(buf, n > 0 ? n : 0, magics[i], NULL, 0, &body);
+        if (g > gen) gen = g;
+    }
+    return gen;
+}
+
+struct journal *journalOpen(const char *path) {
+    struct journal *j = calloc(1, sizeof(struct journal));
+    j->path = strdup(path);
+    j->fd = -1;
+    j->gen = journalLastGen(path) + 1;
+    j->base = "file";
+    j->sync_timer = eventLoopAddTimer(journalSyncTimer, j);
+    j->autosave_timer = eventLoopAddTimer(journalAutosaveTimer, j);
+    return j;
+}
+
+// Stop journaling and drop the recovery files. The writer finishes what
+// was queued before.
+void journalClose(struct journal *j) {
+    if (!j) return;
+    eventLoopRemoveTimer(j->sync_timer);
+    eventLoopRemoveTimer(j->autosave_timer);
+    abFree(&j->pending);
+    journalQueue(journalJobNew(JOB_CLOSE, j));
+}
+
+void journalRecord(enum journalOp op, int row, int at, const char *s, size_t len) {
+    struct journal *j = E.journal;
+    if (!j || j->suspended) return;
+    char head[JOURNAL_RECORD_HEAD];
+    int32_t fields[3] = {row, at, (int32_t)len};
+    head[0] = op;
+    memcpy(&head[1], fields, sizeof(fields));
+
+    int start = j->pending.len;
+    abAppend(&j->pending, head, sizeof(head));
+    if (len) abAppend(&j->pending, s, len);
+    uint32_t sum = journalChecksum(&j->pending.b[start], j->pending.len - start);
+    abAppend(&j->pending, (char *)&sum, sizeof(sum));
+
+    if (start == 0) eventLoopArmTimer(j->sync_timer, KILO_JOURNAL_SYNC, 0);
+    if (j->records++ == 0) eventLoopArmTimer(j->autosave_timer, KILO_AUTOSAVE_INTERVAL * 1000, 0);
+    // Big pastes don't wait for the timer
+    if (j->pending.len >= KILO_LOAD_CHUNK) journalFlush(j);
+}
+
+// Rows coming from disk are already in the base file
+void journalSuspend(void) {
+    if (E.journal) E.journal->suspended++;
+}
+
+void journalResume(void) {
+    if (E.journal) E.journal->suspended--;
+}
+
+// Write the buffer as it is now to the autosave file and start a new,
+// empty journal on top of it
+void journalCheckpoint(struct journal *j) {
+    journalFlush(j);
+    struct journalJob *job = journalJobNew(JOB_CHECKPOINT, j);
+    job->gen = ++j->gen;
+    j->base = "autosave";
+    j->records = 0;
+    job->snap = editorSnapshot();
+    journalQueue(job);
+}
+
+// The buffer matches the file on disk again, start journaling from there
+void journalRebase(struct journal *j) {
+    journalFlush(j);
+    struct journalJob *job = journalJobNew(JOB_REBASE, j);
+    job->gen = ++j->gen;
+    j->base = "file";
+    j->records = 0;
+    eventLoopArmTimer(j->autosave_timer, 0, 0);
+    journalQueue(job);
+}
+
+// Write the buffer to path on the writer thread and call done on the UI
+// thread with the outcome
+void journalSave(struct journal *j, const char *path,
+        void (*done)(int err, long long bytes, void *arg), void *arg) {
+    journalFlush(j);
+    struct journalJob *job = journalJobNew(JOB_SAVE, j);
+    job->gen = ++j->gen;
+    j->base = "file";
+    j->records = 0;
+    eventLoopArmTimer(j->autosave_timer, 0, 0);
+    job->snap = editorSnapshot();
+    job->path = strdup(path);
+    job->done = done;
+    job->arg = arg;
+    journalQueue(job);
+}
+
+// Close the journal and wait until everything queued is on disk
+void journalShutdown(void) {
+    journalClose(E.journal);
+    E.journal = NULL;
+    pthread_mutex_lock(&writer_lock);
+    while (job_head || writer_busy) pthread_cond_wait(&writer_cond, &writer_lock);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+/*** recovery ***/
+// Apply one journal record to E, -1 if it doesn't fit the buffer
+static int journalApply(int op, int row, int at, const char *s, int len) {
+    if (op == JOURNAL_INSERT_ROW) {
+        if (row < 0 || row > E.numrows) return -1;
+        editorInsertRow(row, (char *)s, len);
+        return 0;
+    }
+    if (row < 0 || row >= E.numrows) return -1;
+    erow *r = &E.row[row];
+    switch (op) {
+        case JOURNAL_DEL_ROW:
+            editorDelRow(row);
+            return 0;
+        case JOURNAL_INSERT_CHAR:
+            if (at < 0 || at > r->size || len != 1) return -1;
+            editorRowInsertChar(r, at, (unsigned char)s[0]);
+            return 0;
+        case JOURNAL_DEL_CHAR:
+            if (at < 0 || at >= r->size) return -1;
+            editorRowDelChar(r, at);
+            return 0;
+        case JOURNAL_APPEND:
+            editorRowAppendString(r, (char *)s, len);
+            return 0;
+        case JOURNAL_TRUNCATE:
+            if (at < 0 || at > r->size) return -1;
+            editorRowTruncate(r, at);
+            return 0;
+    }
+    return -1;
+}
+
+// Replay records until the first torn or corrupt one. Counts them only
+// when apply is 0.
+static int journalReplay(const char *s, size_t len, int apply) {
+    int count = 0;
+    while (len >= JOURNAL_RECORD_HEAD + JOURNAL_RECORD_TAIL) {
+        int32_t fields[3];
+        memcpy(fields, s + 1, sizeof(fields));
+        if (fields[2] < 0 || (size_t)fields[2] > len - JOURNAL_RECORD_HEAD - JOURNAL_RECORD_TAIL) break;
+        size_t reclen = JOURNAL_RECORD_HEAD + fields[2];
+        uint32_t sum;
+        memcpy(&sum, s + reclen, sizeof(sum));
+        if (sum != journalChecksum(s, reclen)) break;
+        if (apply && journalApply(s[0], fields[0], fields[1], s + JOURNAL_RECORD_HEAD, fields[2]) == -1) break;
+        count++;
+        s += reclen + JOURNAL_RECORD_TAIL;
+        len -= reclen + JOURNAL_RECORD_TAIL;
+    }
+    return count;
+}
+
+static void journalLoadText(const char *s, size_t len) {
+    const char *end = s + len;
+    while (s < end) {
+        const char *nl = memchr(s, '\n', end - s);
+        size_t linelen = nl ? (size_t)(nl - s) : (size_t)(end - s);
+        editorInsertRow(E.numrows, (char *)s, linelen);
+        s += linelen + 1;
+    }
+}
+
+// Rebuild the buffer for path from the files a crashed session left
+// behind. Returns how many edits were recovered, or -1 if there was
+// nothing to recover and the file should be opened as usual.
+int journalRecover(const char *path) {
+    char *jpath = journalPath(path, ".journal");
+    char *apath = journalPath(path, ".autosave");
+    size_t jlen = 0, alen = 0, jbody = 0, abody = 0;
+    char *jbuf = journalReadFile(jpath, &jlen);
+    char *abuf = journalReadFile(apath, &alen);
+    char base[32] = "";
+    long long jgen = journalHeader(jbuf, jlen, "kilo-journal", base, sizeof(base), &jbody);
+    long long agen = journalHeader(abuf, alen, "kilo-autosave", NULL, 0, &abody);
+
+    int from_autosave = 0;
+    int records = 0;
+    if (agen != -1 && agen > jgen) {
+        // Crashed between writing the autosave and its journal
+        from_autosave = 1;
+    } else if (jgen != -1 && (!strcmp(base, "file") || agen == jgen)) {
+        from_autosave = strcmp(base, "file") != 0;
+        records = journalReplay(jbuf + jbody, jlen - jbody, 0);
+    } else {
+        from_autosave = -1;
+    }
+
+    int recovered = -1;
+    if (from_autosave == 1 || (from_autosave == 0 && records > 0)) {
+        if (from_autosave) {
+            journalLoadText(abuf + abody, alen - abody);
+        } else if (editorLoadStart(path) == 0) {
+            editorLoadFinish();
+        }
+        recovered = records ? journalReplay(jbuf + jbody, jlen - jbody, 1) : 0;
+        E.dirty = 1;
+    }
+    free(jbuf);
+    free(abuf);
+    free(jpath);
+    free(apath);
+    return recovered;
+}
@@ -0,0 +1,52 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+
+#include <stddef.h>
+
+/* Crash recovery journal and background writes.
+ *
+ * Every row edit is appended to an in-memory batch as a checksummed
+ * record. A timer hands the batch to the writer thread every
+ * KILO_JOURNAL_SYNC ms, which appends it to "<file>.journal" and fsyncs.
+ * Every KILO_AUTOSAVE_INTERVAL seconds of editing the writer also dumps a
+ * snapshot of the buffer to "<file>.autosave" and starts a fresh journal
+ * on top of it. Saving goes through the same thread, so the UI never
+ * waits on the disk.
+ *
+ * Both files carry a generation number in their header line. The journal
+ * replays onto the file on disk or onto the autosave of its own
+ * generation; an autosave newer than the journal already holds all of it.
+ */
+enum journalOp {
+    JOURNAL_INSERT_ROW = 'I',
+    JOURNAL_DEL_ROW = 'D',
+    JOURNAL_INSERT_CHAR = 'c',
+    JOURNAL_DEL_CHAR = 'x',
+    JOURNAL_APPEND = 'a',
+    JOURNAL_TRUNCATE = 't',
+};
+
+struct journal;
+
+struct journal *journalOpen(const char *path);
+
+void journalClose(struct journal *j);
+
+int journalRecover(const char *path);
+
+void journalRecord(enum journalOp op, int row, int at, const char *s, size_t len);
+
+void journalSuspend(void);
+
+void journalResume(void);
+
+void journalCheckpoint(struct journal *j);
+
+void journalRebase(struct journal *j);
+
+void journalSave(struct journal *j, const char *path,
+        void (*done)(int err, long long bytes, void *arg), void *arg);
+
+void journalShutdown(void);
+
+#endif
@@ -5,63 +5,114 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "buffer.h"
+#include "client.h"
+#include "editor.h"
+#include "eventloop.h"
 #include "fileio.h"
+#include "follow.h"
+#include "server.h"
 #include "terminal.h"
 #include "draw.h"
 #include "userinput.h"
 
-/*** data ***/
-struct editorConfig E;
+// Work off every queued key before drawing a single frame
+static void editorMainLoop(void) {
+    while (1) {
+        eventLoopWait(-1);
+        while (editorInputPending()) {
+            editorProcessKeypress();
+            eventLoopRequestRedraw();
+        }
+        eventLoopFlushRedraw();
+    }
+}
 
-/*** init ***/
-void initEditor(void) {
-    /* Initialize the E struct */
-    E.cx = 0;
-    E.cy = 0;
-    E.rx = 0;
-    E.cursor_pos = 0;
-    E.rowoff = 0;
-    E.coloff = 0;
-    E.row = NULL;
-    E.dirty = 0;
-    E.filename = NULL;
-    E.copy_buffer = NULL;
-    E.prev_char = ' ';
-    E.lineno_offset = 2;
-    E.statusMessage[0] = '\0';
-    E.statusmsg_time = 0;
-    E.syntax = NULL;
-    E.select_end_x = 0;
-    E.select_end_y = 0;
-    E.select_start_x = 0;
-    E.select_start_y = 0;
-    int code = getWindowSize(&E.screenrows, &E.screencols);
-    if (code == -1) die("getWindowSize");
-    E.screenrows -= 2;
+// Run the daemon on listen_fd in a grandchild, with no terminal of its
+// own. Only the caller returns.
+static void editorDaemonize(int listen_fd) {
+    pid_t pid = fork();
+    if (pid == -1) die("fork");
+    if (pid > 0) {
+        close(listen_fd);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+    setsid();
+    if (fork() != 0) _exit(0);
+    int null = open("/dev/null", O_RDWR);
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    if (null > STDERR_FILENO) close(null);
+
+    eventLoopInit();
+    initEditor();
+    serverStart(listen_fd);
+    editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-F = find | Ctrl-E = command | Ctrl-Q = detach");
+    editorMainLoop();
 }
 
 int main(int argc, char *argv[]) {
+    int rows, cols;
+    // kilo --daemon keeps buffers open for clients to attach to
+    if (argc >= 2 && !strcmp(argv[1], "--daemon")) {
+        int listen_fd = serverBind();
+        if (listen_fd == -1) {
+            perror("kilo: daemon");
+            return 1;
+        }
+        editorDaemonize(listen_fd);
+        return 0;
+    }
+    // kilo -c [-f] [file...] attaches to it, starting one if need be
+    if (argc >= 2 && !strcmp(argv[1], "-c")) {
+        int fd = serverConnect();
+        if (fd == -1) {
+            int listen_fd = serverBind();
+            if (listen_fd != -1) editorDaemonize(listen_fd);
+            fd = serverConnect();
+        }
+        if (fd == -1) {
+            perror("kilo: connect");
+            return 1;
+        }
+        int follow = argc >= 3 && !strcmp(argv[2], "-f");
+        clientRun(fd, follow, argc - 2 - follow, argv + 2 + follow);
+    }
+
+    eventLoopInit();
     initEditor();
+    if (getWindowSize(&rows, &cols) == -1) die("getWindowSize");
+    editorResize(rows, cols);
     enableRawMode();
-    if (argc >= 2) {
-        editorOpen(argv[1]);
+    eventLoopAddFd(STDIN_FILENO, editorTerminalInput, NULL);
+    eventLoopAddSignal(SIGWINCH, editorHandleResize);
+    // Set first, so anything editorOpen has to say replaces it
+    editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-F = find | Ctrl-E = command | Ctrl-Q = quit\0");
+    // kilo -f file follows the file as it grows
+    int follow = argc >= 3 && !strcmp(argv[1], "-f");
+    if (argc >= 2 + follow) {
+        editorOpen(argv[1 + follow]);
+        if (follow && editorFollowStart() == -1) die("follow");
     }
+    // Any further files load into buffers behind the first
+    for (int i = 2 + follow; i < argc; i++) bufferOpen(argv[i]);
+    if (argc > 2 + follow) bufferSwitch(0);
 
-    editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-F = find | Ctrl-Q = quit\0");
-
-    while (1) {
-        editorRefreshScreen();
-        editorProcessKeypress();
-    } return 0;
-
+    editorRefreshScreen();
+    editorMainLoop();
+    return 0;
 }
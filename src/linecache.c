@@ -0,0 +1,252 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "diff.h"
+#include "editor_ops.h"
+#include "linecache.h"
+#include "syntax.h"
+
+#define LINE_CACHE_MAGIC 0x786469206f6c696bULL
+// Bump when the file layout or the highlighter's comment rules change
+#define LINE_CACHE_VERSION 1
+#define LINE_CACHE_SAMPLE 4096
+
+// Followed by nrows + 1 row starts, the last one the file size, and a
+// bit per row, set where the row ends inside a block comment
+struct lineCacheHeader {
+    uint64_t magic;
+    uint64_t version;
+    struct lineCacheKey key;
+    uint64_t nrows;
+};
+
+struct lineCache {
+    void *map;
+    size_t maplen;
+    const struct lineCacheHeader *h;
+    const uint64_t *starts;
+    const unsigned char *bits;
+};
+
+struct lineCacheWrite {
+    char *path;
+    char *data;
+    size_t len;
+};
+
+/*** keys ***/
+// Hash of the first, middle and last block: changes that keep the size
+// and the mtime rarely miss all three
+static uint64_t lineCacheSample(int fd, uint64_t size) {
+    char buf[3 * LINE_CACHE_SAMPLE];
+    uint64_t at[3] = {0, size / 2, size > LINE_CACHE_SAMPLE ? size - LINE_CACHE_SAMPLE : 0};
+    size_t len = 0;
+    for (int i = 0; i < 3; i++) {
+        ssize_t n = pread(fd, &buf[len], LINE_CACHE_SAMPLE, at[i]);
+        if (n > 0) len += n;
+    }
+    return diffHash(buf, len);
+}
+
+// What a cache must have been written for to be used for fd
+int lineCacheKeyFor(int fd, struct lineCacheKey *key) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) return -1;
+    memset(key, 0, sizeof(struct lineCacheKey));
+    key->size = st.st_size;
+    key->mtime_sec = st.st_mtim.tv_sec;
+    key->mtime_nsec = st.st_mtim.tv_nsec;
+    key->ino = st.st_ino;
+    key->sample = lineCacheSample(fd, key->size);
+    const char *filetype = E.syntax ? E.syntax->filetype : "";
+    key->syntax = diffHash(filetype, strlen(filetype));
+    return 0;
+}
+
+// The cache file for filename, NULL if there is nowhere to keep one
+static char *lineCachePath(const char *filename, int create) {
+    char dir[4096];
+    const char *env = getenv("KILO_CACHE_DIR");
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (env && *env) snprintf(dir, sizeof(dir), "%s", env);
+    else if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s/kilo", xdg);
+    else if (home && *home) snprintf(dir, sizeof(dir), "%s/.cache/kilo", home);
+    else return NULL;
+    if (create) {
+        // Parents first, only the last two levels are likely missing
+        char *slash = strrchr(dir, '/');
+        if (slash && slash != dir) {
+            *slash = '\0';
+            mkdir(dir, 0700);
+            *slash = '/';
+        }
+        if (mkdir(dir, 0700) == -1 && errno != EEXIST) return NULL;
+    }
+
+    char *real = realpath(filename, NULL);
+    if (!real) return NULL;
+    uint64_t h = diffHash(real, strlen(real));
+    free(real);
+    char *path = malloc(strlen(dir) + 32);
+    sprintf(path, "%s/%016llx.idx", dir, (unsigned long long)h);
+    return path;
+}
+
+/*** reading ***/
+static size_t lineCacheBytes(uint64_t nrows) {
+    return sizeof(struct lineCacheHeader) + sizeof(uint64_t) * (nrows + 1) + (nrows + 7) / 8;
+}
+
+// Map the cache for filename if it was written for key, else NULL
+struct lineCache *lineCacheOpen(const char *filename, const struct lineCacheKey *key) {
+    char *path = lineCachePath(filename, 0);
+    if (!path) return NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (fd == -1) return NULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct lineCacheHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const struct lineCacheHeader *h = map;
+    if (h->magic != LINE_CACHE_MAGIC || h->version != LINE_CACHE_VERSION ||
+            memcmp(&h->key, key, sizeof(struct lineCacheKey)) != 0 ||
+            h->nrows > (uint64_t)st.st_size || lineCacheBytes(h->nrows) != (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    struct lineCache *c = malloc(sizeof(struct lineCache));
+    c->map = map;
+    c->maplen = st.st_size;
+    c->h = h;
+    c->starts = (const uint64_t *)(h + 1);
+    c->bits = (const unsigned char *)(c->starts + h->nrows + 1);
+    if (c->starts[h->nrows] != key->size) {
+        lineCacheClose(c);
+        return NULL;
+    }
+    // Rows are read front to back, once
+    madvise(map, c->maplen, MADV_SEQUENTIAL);
+    return c;
+}
+
+void lineCacheClose(struct lineCache *c) {
+    if (!c) return;
+    munmap(c->map, c->maplen);
+    free(c);
+}
+
+long long lineCacheRows(struct lineCache *c) {
+    return c->h->nrows;
+}
+
+// Offset of the row's first byte. Row nrows starts at the end of the file.
+uint64_t lineCacheStart(struct lineCache *c, long long row) {
+    return c->starts[row];
+}
+
+int lineCacheOpenComment(struct lineCache *c, long long row) {
+    return (c->bits[row / 8] >> (row % 8)) & 1;
+}
+
+/*** writing ***/
+// Writes still going, waited for at exit so none leaves its .tmp behind
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
+static int writes = 0;
+
+static void lineCacheWaitWrites(void) {
+    pthread_mutex_lock(&write_lock);
+    while (writes > 0) pthread_cond_wait(&write_cond, &write_lock);
+    pthread_mutex_unlock(&write_lock);
+}
+
+static void *lineCacheWriteThread(void *arg) {
+    struct lineCacheWrite *w = arg;
+    char *tmp = malloc(strlen(w->path) + 32);
+    sprintf(tmp, "%s.%d.tmp", w->path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    size_t done = 0;
+    while (fd != -1 && done < w->len) {
+        ssize_t n = write(fd, &w->data[done], w->len - done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += n;
+    }
+    if (fd != -1) close(fd);
+    // Readers only ever see a whole cache or none
+    if (done == w->len) rename(tmp, w->path);
+    else unlink(tmp);
+    free(tmp);
+    free(w->path);
+    free(w->data);
+    free(w);
+    pthread_mutex_lock(&write_lock);
+    writes--;
+    pthread_cond_broadcast(&write_cond);
+    pthread_mutex_unlock(&write_lock);
+    return NULL;
+}
+
+// Keep starts, nrows + 1 of them, with the comment state of E's first
+// nrows rows, for the next load of filename. Takes starts; the file is
+// written off the UI thread.
+void lineCacheSave(const char *filename, const struct lineCacheKey *key, uint64_t *starts,
+        long long nrows) {
+    char *path = lineCachePath(filename, 1);
+    if (!path) {
+        free(starts);
+        return;
+    }
+    struct lineCacheWrite *w = malloc(sizeof(struct lineCacheWrite));
+    w->path = path;
+    w->len = lineCacheBytes(nrows);
+    w->data = calloc(1, w->len);
+    struct lineCacheHeader *h = (struct lineCacheHeader *)w->data;
+    h->magic = LINE_CACHE_MAGIC;
+    h->version = LINE_CACHE_VERSION;
+    h->key = *key;
+    h->nrows = nrows;
+    memcpy(h + 1, starts, sizeof(uint64_t) * (nrows + 1));
+    free(starts);
+    unsigned char *bits = (unsigned char *)(w->data + sizeof(struct lineCacheHeader)) +
+        sizeof(uint64_t) * (nrows + 1);
+    for (long long i = 0; i < nrows && i < E.numrows; i++) {
+        if (E.row[i].hl_open_comment) bits[i / 8] |= 1 << (i % 8);
+    }
+
+    static int registered = 0;
+    if (!registered) {
+        atexit(lineCacheWaitWrites);
+        registered = 1;
+    }
+    pthread_mutex_lock(&write_lock);
+    writes++;
+    pthread_mutex_unlock(&write_lock);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, lineCacheWriteThread, w) != 0) {
+        free(w->path);
+        free(w->data);
+        free(w);
+        pthread_mutex_lock(&write_lock);
+        writes--;
+        pthread_mutex_unlock(&write_lock);
+        return;
+    }
+    pthread_detach(thread);
+}
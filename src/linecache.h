@@ -0,0 +1,46 @@
+#ifndef LINECACHE_H_
+#define LINECACHE_H_
+
+#include <stdint.h>
+
+/* Line index cache for fast reopen.
+ *
+ * Loading a big file finds every newline and highlights every row, only
+ * to learn where rows start and which of them end inside a block
+ * comment. Once a load finishes untouched, both go to a cache file under
+ * $KILO_CACHE_DIR (else $XDG_CACHE_HOME/kilo or ~/.cache/kilo), named
+ * after the file's path: a header, the start offset of each row and a
+ * bit per row for the comment state. The next load maps it and, if the
+ * file still has the same size, mtime, inode and sampled contents and the
+ * same syntax, takes rows straight from the index and leaves
+ * highlighting to the first frame that shows them.
+ */
+struct lineCacheKey {
+    uint64_t size;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+    uint64_t ino;
+    // Hash of a few blocks of the file
+    uint64_t sample;
+    // Hash of the filetype the comment states belong to
+    uint64_t syntax;
+};
+
+struct lineCache;
+
+int lineCacheKeyFor(int fd, struct lineCacheKey *key);
+
+struct lineCache *lineCacheOpen(const char *filename, const struct lineCacheKey *key);
+
+void lineCacheClose(struct lineCache *c);
+
+long long lineCacheRows(struct lineCache *c);
+
+uint64_t lineCacheStart(struct lineCache *c, long long row);
+
+int lineCacheOpenComment(struct lineCache *c, long long row);
+
+void lineCacheSave(const char *filename, const struct lineCacheKey *key, uint64_t *starts,
+        long long nrows);
+
+#endif
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+
+#include "terminal.h"
+#include "fenwick.h"
+#include "lineindex.h"
+
+/*** tree ***/
+// Counted on first use
+static struct fenwick *lineIndexTree(void) {
+    if (!E.offsets) {
+        E.offsets = calloc(1, sizeof(struct fenwick));
+        for (int i = 0; i < E.numrows; i++) fenwickInsert(E.offsets, i, E.row[i].size + E.row[i].eol);
+    }
+    return E.offsets;
+}
+
+/*** edits ***/
+void lineIndexRowChanged(erow *row) {
+    if (!E.offsets || row->idx >= E.offsets->n) return;
+    if (fenwickGet(E.offsets, row->idx) != row->size + row->eol) {
+        fenwickSet(E.offsets, row->idx, row->size + row->eol);
+    }
+}
+
+void lineIndexInsertRow(int at) {
+    if (!E.offsets || at > E.offsets->n) return;
+    fenwickInsert(E.offsets, at, E.row[at].size + E.row[at].eol);
+}
+
+void lineIndexDelRow(int at) {
+    if (!E.offsets || at >= E.offsets->n) return;
+    fenwickDelete(E.offsets, at);
+}
+
+// Saved: every row on disk now ends in a newline
+void lineIndexSaved(void) {
+    int changed = 0;
+    for (int i = 0; i < E.numrows; i++) {
+        if (E.row[i].eol != 1) {
+            E.row[i].eol = 1;
+            changed = 1;
+        }
+    }
+    if (changed) lineIndexFree();
+}
+
+void lineIndexFree(void) {
+    if (!E.offsets) return;
+    fenwickFree(E.offsets);
+    free(E.offsets);
+    E.offsets = NULL;
+}
+
+/*** lookups ***/
+// Offset of byte col of row
+long long lineIndexOffset(int row, int col) {
+    return fenwickPrefix(lineIndexTree(), row) + col;
+}
+
+// The row byte `offset` is in, and in *col where in the row. Past the end
+// is the end of the last row.
+int lineIndexRowAt(long long offset, int *col) {
+    struct fenwick *f = lineIndexTree();
+    if (offset < 0) offset = 0;
+    int row = fenwickFind(f, offset);
+    if (row >= f->n) {
+        *col = f->n ? E.row[f->n - 1].size : 0;
+        return f->n ? f->n - 1 : 0;
+    }
+    // The line end belongs to the end of its row, both bytes of a CRLF
+    *col = offset - fenwickPrefix(f, row);
+    if (*col > E.row[row].size) *col = E.row[row].size;
+    return row;
+}
+
+// Bytes in the buffer
+long long lineIndexSize(void) {
+    struct fenwick *f = lineIndexTree();
+    return fenwickPrefix(f, f->n);
+}
@@ -0,0 +1,33 @@
+#ifndef LINEINDEX_H_
+#define LINEINDEX_H_
+
+#include "terminal.h"
+
+/* Byte offsets of rows.
+ *
+ * A Fenwick tree over the bytes every row takes in the file, its line end
+ * included, so the offset of a row and the row an offset falls in are
+ * both O(log n) however big the file. It is counted the first time it is
+ * asked for and from then on kept up by the row operations in
+ * editor_ops.c. Offsets are into the file on disk: rows count the line end
+ * they were loaded with, CRLF or none, and rows added since the newline a
+ * save gives them. A save writes newlines only, so after one every row
+ * counts one.
+ */
+long long lineIndexOffset(int row, int col);
+
+int lineIndexRowAt(long long offset, int *col);
+
+long long lineIndexSize(void);
+
+void lineIndexRowChanged(erow *row);
+
+void lineIndexInsertRow(int at);
+
+void lineIndexDelRow(int at);
+
+void lineIndexSaved(void);
+
+void lineIndexFree(void);
+
+#endif
@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "buffer.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "journal.h"
+#include "linecache.h"
+#include "lineindex.h"
+#include "loader.h"
+#include "profile.h"
+#include "reload.h"
+#include "syntax.h"
+
+struct editorLoader {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int fd;
+    off_t size;
+    // Pieces posted but not applied yet
+    int inflight;
+    int cancelled;
+    // Thread joined, the loader goes once the last piece is drained
+    int joined;
+    int error;
+    // Rows of the file applied so far, whatever E.numrows says
+    long long rows;
+    struct lineCacheKey key;
+    // The file's line cache, while it agrees with what is read
+    struct lineCache *cache;
+    // Otherwise where each row started, to write one from
+    uint64_t *starts;
+    long long starts_cap;
+};
+
+struct loadPiece {
+    struct editorLoader *loader;
+    char *data;
+    size_t len;
+    int last;
+};
+
+/*** loader thread ***/
+static void editorLoadPost(struct editorLoader *ld, char *data, size_t len, int last);
+
+static void *editorLoadThread(void *arg) {
+    struct editorLoader *ld = arg;
+    char *carry = NULL;
+    size_t carry_len = 0;
+    while (1) {
+        pthread_mutex_lock(&ld->lock);
+        while (ld->inflight >= KILO_LOAD_INFLIGHT && !ld->cancelled) {
+            pthread_cond_wait(&ld->cond, &ld->lock);
+        }
+        int cancelled = ld->cancelled;
+        pthread_mutex_unlock(&ld->lock);
+        if (cancelled) break;
+
+        char *buf = malloc(carry_len + KILO_LOAD_CHUNK);
+        if (carry_len) memcpy(buf, carry, carry_len);
+        ssize_t n = read(ld->fd, buf + carry_len, KILO_LOAD_CHUNK);
+        if (n == -1 && errno == EINTR) {
+            free(buf);
+            continue;
+        }
+        if (n <= 0) {
+            // Whatever is left is the last line, without a newline
+            if (n == -1) ld->error = errno;
+            editorLoadPost(ld, buf, carry_len, 1);
+            break;
+        }
+        size_t len = carry_len + n;
+        char *nl = memrchr(buf, '\n', len);
+        if (!nl) {
+            // One line longer than a chunk, keep reading
+            free(carry);
+            carry = buf;
+            carry_len = len;
+            continue;
+        }
+        size_t used = nl - buf + 1;
+        carry_len = len - used;
+        carry = realloc(carry, carry_len ? carry_len : 1);
+        memcpy(carry, buf + used, carry_len);
+        editorLoadPost(ld, buf, used, 0);
+    }
+    free(carry);
+    return NULL;
+}
+
+/*** ui thread ***/
+// The row just appended ends in the len bytes its line did on disk
+static void editorLoadEol(size_t len) {
+    erow *row = &E.row[E.numrows - 1];
+    row->eol = len;
+    lineIndexRowChanged(row);
+}
+
+static void editorLoadRecord(struct editorLoader *ld, uint64_t start) {
+    if (ld->rows + 1 >= ld->starts_cap) {
+        ld->starts_cap = ld->starts_cap ? ld->starts_cap * 2 : 4096;
+        ld->starts = realloc(ld->starts, sizeof(uint64_t) * ld->starts_cap);
+    }
+    ld->starts[ld->rows++] = start;
+}
+
+// Append the lines in s as rows, the first one starting at offset from
+// in the file. Rows read from disk are not edits.
+static void editorLoadLines(struct editorLoader *ld, char *s, size_t len, uint64_t from) {
+    int dirty = E.dirty;
+    journalSuspend();
+    char *start = s, *end = s + len;
+    while (s < end) {
+        char *nl = memchr(s, '\n', end - s);
+        size_t linelen = nl ? (size_t)(nl - s) : (size_t)(end - s);
+        char *next = s + linelen + 1;
+        if (ld && ld->starts) editorLoadRecord(ld, from + (s - start));
+        else if (ld) ld->rows++;
+        size_t eol = nl ? 1 : 0;
+        while (linelen > 0 && (s[linelen - 1] == '\n' || s[linelen - 1] == '\r')) {
+            linelen--;
+            eol++;
+        }
+        editorInsertRow(E.numrows, s, linelen);
+        editorLoadEol(eol);
+        editorSavedAppend(s, linelen);
+        s = next;
+    }
+    journalResume();
+    E.dirty = dirty;
+}
+
+void editorLoadAppend(char *s, size_t len) {
+    editorLoadLines(NULL, s, len, 0);
+}
+
+// Append the rows of s the cache has an entry for, without looking for
+// newlines or highlighting. Returns how much of s that took: less than
+// len where the cache turns out not to match the file.
+static size_t editorLoadCached(struct editorLoader *ld, char *s, size_t len, uint64_t from) {
+    struct lineCache *c = ld->cache;
+    int dirty = E.dirty;
+    size_t used = 0;
+    journalSuspend();
+    editorSyntaxDefer(1);
+    while (used < len && ld->rows < lineCacheRows(c)) {
+        uint64_t next = lineCacheStart(c, ld->rows + 1);
+        // A cache that is cut short or garbled need not have rows in order
+        if (lineCacheStart(c, ld->rows) != from + used || next <= from + used ||
+                next > from + len) break;
+        size_t linelen = next - from - used;
+        // Every row but the file's last ends at a newline
+        if (s[used + linelen - 1] != '\n' && ld->rows + 1 < lineCacheRows(c)) break;
+        char *line = &s[used];
+        used += linelen;
+        size_t eol = 0;
+        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r')) {
+            linelen--;
+            eol++;
+        }
+        editorInsertRow(E.numrows, line, linelen);
+        editorLoadEol(eol);
+        editorSavedAppend(line, linelen);
+        E.row[E.numrows - 1].hl_open_comment = lineCacheOpenComment(c, ld->rows);
+        ld->rows++;
+    }
+    editorSyntaxDefer(0);
+    journalResume();
+    E.dirty = dirty;
+    return used;
+}
+
+// The cache was stale after all: highlight what came from it the usual
+// way, and keep its row starts up to there to write a new one
+static void editorLoadDropCache(struct editorLoader *ld) {
+    struct lineCache *c = ld->cache;
+    ld->cache = NULL;
+    ld->starts_cap = ld->rows + 4096;
+    ld->starts = malloc(sizeof(uint64_t) * ld->starts_cap);
+    for (long long i = 0; i < ld->rows; i++) ld->starts[i] = lineCacheStart(c, i);
+    lineCacheClose(c);
+    editorUpdateSyntaxRows(0, E.numrows - 1);
+}
+
+static void editorLoadPiece(struct editorLoader *ld, char *s, size_t len) {
+    uint64_t from = E.file_bytes;
+    size_t used = 0;
+    if (ld->cache) {
+        used = editorLoadCached(ld, s, len, from);
+        if (used < len) editorLoadDropCache(ld);
+    }
+    if (used < len) editorLoadLines(ld, &s[used], len - used, from + used);
+    E.file_bytes += len;
+}
+
+// The whole file went in unchanged: the next load can skip both scans
+static void editorLoadSaveCache(struct editorLoader *ld) {
+    if (!ld->starts || ld->error || E.dirty || ld->rows != E.numrows) return;
+    ld->starts[ld->rows] = E.file_bytes;
+    lineCacheSave(E.filename, &ld->key, ld->starts, ld->rows);
+    ld->starts = NULL;
+}
+
+static void editorLoadDestroy(struct editorLoader *ld) {
+    lineCacheClose(ld->cache);
+    free(ld->starts);
+    pthread_mutex_destroy(&ld->lock);
+    pthread_cond_destroy(&ld->cond);
+    free(ld);
+}
+
+static void editorLoadJoin(struct editorLoader *ld) {
+    pthread_join(ld->thread, NULL);
+    close(ld->fd);
+    ld->joined = 1;
+}
+
+static void editorLoadApply(void *arg) {
+    struct loadPiece *p = arg;
+    struct editorLoader *ld = p->loader;
+    // The buffer may be in the background by now
+    int prev = bufferEnter(offsetof(struct editorConfig, loader), ld);
+
+    if (ld == E.loader) {
+        PROFILE_BEGIN(PROF_OPEN);
+        editorLoadPiece(ld, p->data, p->len);
+        eventLoopRequestRedraw();
+        PROFILE_END(PROF_OPEN);
+    }
+
+    pthread_mutex_lock(&ld->lock);
+    ld->inflight--;
+    pthread_cond_signal(&ld->cond);
+    pthread_mutex_unlock(&ld->lock);
+
+    if (ld == E.loader && p->last) {
+        E.loader = NULL;
+        editorLoadJoin(ld);
+        editorLoadSaveCache(ld);
+        if (ld->error) editorSetStatusMessage("Can't read %s: %s", E.filename, strerror(ld->error));
+        editorLoadDestroy(ld);
+    } else if (ld != E.loader && ld->joined && ld->inflight == 0) {
+        // Last piece of a cancelled load
+        editorLoadDestroy(ld);
+    }
+    bufferLeave(prev);
+    free(p->data);
+    free(p);
+}
+
+static void editorLoadPost(struct editorLoader *ld, char *data, size_t len, int last) {
+    struct loadPiece *p = malloc(sizeof(struct loadPiece));
+    p->loader = ld;
+    p->data = data;
+    p->len = len;
+    p->last = last;
+    pthread_mutex_lock(&ld->lock);
+    ld->inflight++;
+    pthread_mutex_unlock(&ld->lock);
+    eventLoopPost(editorLoadApply, p);
+}
+
+int editorLoadStart(const char *filename) {
+    editorLoadCancel();
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    struct editorLoader *ld = calloc(1, sizeof(struct editorLoader));
+    struct stat st;
+    ld->fd = fd;
+    ld->size = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : 0;
+    // Only big files are worth a cache
+    if (ld->size >= KILO_CACHE_MIN_SIZE && lineCacheKeyFor(fd, &ld->key) == 0) {
+        ld->cache = lineCacheOpen(filename, &ld->key);
+        if (!ld->cache) {
+            ld->starts_cap = 4096;
+            ld->starts = malloc(sizeof(uint64_t) * ld->starts_cap);
+        }
+    }
+    pthread_mutex_init(&ld->lock, NULL);
+    pthread_cond_init(&ld->cond, NULL);
+    // Pieces are posted from the thread, so the loop has to exist first
+    eventLoopInit();
+    if (pthread_create(&ld->thread, NULL, editorLoadThread, ld) != 0) die("pthread_create");
+    E.loader = ld;
+    return 0;
+}
+
+void editorLoadCancel(void) {
+    struct editorLoader *ld = E.loader;
+    if (!ld) return;
+    E.loader = NULL;
+    pthread_mutex_lock(&ld->lock);
+    ld->cancelled = 1;
+    pthread_cond_signal(&ld->cond);
+    pthread_mutex_unlock(&ld->lock);
+    editorLoadJoin(ld);
+    // Otherwise the pieces still queued free it
+    if (ld->inflight == 0) editorLoadDestroy(ld);
+}
+
+// Only wait for the pieces up to the one holding row
+void editorLoadWaitRow(int row) {
+    while (E.loader && E.numrows <= row) eventLoopWait(-1);
+}
+
+void editorLoadFinish(void) {
+    while (E.loader) eventLoopWait(-1);
+}
+
+// Percent of the file loaded, or -1 when not loading
+int editorLoadProgress(void) {
+    struct editorLoader *ld = E.loader;
+    if (!ld) return -1;
+    if (ld->size <= 0) return 0;
+    int pct = E.file_bytes * 100 / ld->size;
+    return pct > 99 ? 99 : pct;
+}
@@ -0,0 +1,28 @@
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <stddef.h>
+
+/* Background file loading.
+ *
+ * A loader thread reads the file in KILO_LOAD_CHUNK pieces, cut at the
+ * last newline, and posts each piece to the UI thread, which appends its
+ * lines to E. At most KILO_LOAD_INFLIGHT pieces wait to be applied, so a
+ * fast disk can't run away from the highlighter. E.loader is set while
+ * rows are still coming in, E.file_bytes counts the bytes applied.
+ */
+struct editorLoader;
+
+int editorLoadStart(const char *filename);
+
+void editorLoadCancel(void);
+
+void editorLoadAppend(char *s, size_t len);
+
+void editorLoadWaitRow(int row);
+
+void editorLoadFinish(void);
+
+int editorLoadProgress(void);
+
+#endif
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "terminal.h"
+#include "memory.h"
+#include "rowalloc.h"
+
+// Snapshots are released from worker threads too, so the counters are
+// only ever touched atomically
+static size_t mem_bytes[MEM_NUM_TAGS];
+static size_t mem_budget = 0;
+static int mem_budget_read = 0;
+
+static const char *mem_names[MEM_NUM_TAGS] = {
+    "rows", "chars", "render", "hl", "layout", "snap", "clip",
+};
+
+static void memCount(enum memTag tag, long long delta) {
+    __atomic_add_fetch(&mem_bytes[tag], (size_t)delta, __ATOMIC_RELAXED);
+}
+
+/*** heap ***/
+void *memAlloc(enum memTag tag, size_t size) {
+    void *p = malloc(size);
+    if (p == NULL) die("malloc");
+    memCount(tag, malloc_usable_size(p));
+    return p;
+}
+
+void *memRealloc(enum memTag tag, void *p, size_t size) {
+    long long old = p ? (long long)malloc_usable_size(p) : 0;
+    p = realloc(p, size);
+    if (p == NULL) die("realloc");
+    memCount(tag, (long long)malloc_usable_size(p) - old);
+    return p;
+}
+
+void memFree(enum memTag tag, void *p) {
+    if (!p) return;
+    memCount(tag, -(long long)malloc_usable_size(p));
+    free(p);
+}
+
+/*** row arena ***/
+// The arena keeps its own per-tag totals, so dropping it in one go can
+// take exactly its share off the global counters
+void *memRowAlloc(struct rowArena *arena, enum memTag tag, size_t size) {
+    void *p = rowAlloc(arena, size);
+    size_t bytes = rowBlockSize(p);
+    arena->tag_bytes[tag] += bytes;
+    memCount(tag, bytes);
+    return p;
+}
+
+void *memRowRealloc(struct rowArena *arena, enum memTag tag, void *p, size_t size) {
+    long long old = p ? (long long)rowBlockSize(p) : 0;
+    p = rowRealloc(arena, p, size);
+    long long delta = (long long)rowBlockSize(p) - old;
+    arena->tag_bytes[tag] += delta;
+    memCount(tag, delta);
+    return p;
+}
+
+void memRowFree(struct rowArena *arena, enum memTag tag, void *p) {
+    if (!p) return;
+    size_t bytes = rowBlockSize(p);
+    arena->tag_bytes[tag] -= bytes;
+    memCount(tag, -(long long)bytes);
+    rowFree(arena, p);
+}
+
+void memArenaReset(struct rowArena *arena) {
+    for (int t = 0; t < MEM_NUM_TAGS; t++) {
+        memCount(t, -(long long)arena->tag_bytes[t]);
+    }
+    rowArenaReset(arena);
+}
+
+/*** reporting ***/
+size_t memTagBytes(enum memTag tag) {
+    return __atomic_load_n(&mem_bytes[tag], __ATOMIC_RELAXED);
+}
+
+const char *memTagName(enum memTag tag) {
+    return mem_names[tag];
+}
+
+size_t memTotalBytes(void) {
+    size_t total = 0;
+    for (int t = 0; t < MEM_NUM_TAGS; t++) total += memTagBytes(t);
+    return total;
+}
+
+/*** budget ***/
+// "512M", "2G", "65536"; -1 if it doesn't parse
+long long memParseSize(const char *s) {
+    char *end;
+    long long n = strtoll(s, &end, 10);
+    if (end == s || n < 0) return -1;
+    switch (toupper((unsigned char)*end)) {
+        case 'K': n <<= 10; end++; break;
+        case 'M': n <<= 20; end++; break;
+        case 'G': n <<= 30; end++; break;
+    }
+    if (toupper((unsigned char)*end) == 'B') end++;
+    return *end ? -1 : n;
+}
+
+// 0 means no budget
+size_t memBudget(void) {
+    if (!mem_budget_read) {
+        mem_budget_read = 1;
+        char *env = getenv("KILO_MEM_BUDGET");
+        long long n = env ? memParseSize(env) : -1;
+        if (n > 0) mem_budget = n;
+    }
+    return mem_budget;
+}
+
+void memSetBudget(size_t bytes) {
+    mem_budget_read = 1;
+    mem_budget = bytes;
+}
@@ -0,0 +1,52 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <stddef.h>
+
+/* Tracked allocations.
+ *
+ * Every long lived allocation is attributed to a subsystem, so the editor
+ * can report where its memory goes and react when it crosses the budget
+ * (KILO_MEM_BUDGET, e.g. "512M", or the "mem budget" command). Row
+ * payloads come from the row arena, everything else from the heap.
+ */
+enum memTag {
+    MEM_ROWS = 0,
+    MEM_CHARS,
+    MEM_RENDER,
+    MEM_HL,
+    MEM_LAYOUT,
+    MEM_SNAPSHOT,
+    MEM_CLIPBOARD,
+    MEM_NUM_TAGS
+};
+
+struct rowArena;
+
+void *memAlloc(enum memTag tag, size_t size);
+
+void *memRealloc(enum memTag tag, void *p, size_t size);
+
+void memFree(enum memTag tag, void *p);
+
+void *memRowAlloc(struct rowArena *arena, enum memTag tag, size_t size);
+
+void *memRowRealloc(struct rowArena *arena, enum memTag tag, void *p, size_t size);
+
+void memRowFree(struct rowArena *arena, enum memTag tag, void *p);
+
+void memArenaReset(struct rowArena *arena);
+
+size_t memTagBytes(enum memTag tag);
+
+const char *memTagName(enum memTag tag);
+
+size_t memTotalBytes(void);
+
+size_t memBudget(void);
+
+void memSetBudget(size_t bytes);
+
+long long memParseSize(const char *s);
+
+#endif
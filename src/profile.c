@@ -0,0 +1,221 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "draw.h"
+#include "profile.h"
+
+#ifndef KILO_NO_PROFILE
+
+// Past this many events the trace stops growing; histograms keep counting
+#define PROFILE_MAX_TRACE (1 << 20)
+
+struct traceEvent {
+    int probe;
+    unsigned long long start;
+    unsigned long long cycles;
+};
+
+struct profileStats profile_stats[PROF_NUM_PROBES];
+
+static const char *probe_names[PROF_NUM_PROBES] = {
+    "editorRefreshScreen", "editorUpdateSyntax", "editorUpdateRow",
+    "editorFindCallback", "editorLoadApply", "editorSave",
+};
+
+static const char *probe_commands[PROF_NUM_PROBES] = {
+    "refresh", "syntax", "update-row", "find", "open", "save",
+};
+
+static int profile_ready = 0;
+static unsigned long long base_cycles;
+static long long base_ns;
+
+static char *trace_path = NULL;
+static struct traceEvent *trace = NULL;
+static long trace_len = 0;
+static long trace_cap = 0;
+
+static int overlay_on = 0;
+static unsigned long long frame_cycles = 0;
+static unsigned long long frame_hl_cycles = 0;
+static unsigned long long hl_cycles = 0;
+static int frame_bytes = 0;
+
+/*** clock ***/
+static long long profileNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Cycles are converted with the rate seen since the first probe, so no
+// start-up calibration is needed
+static double profileCyclesToNs(unsigned long long cycles) {
+    long long ns = profileNs() - base_ns;
+    unsigned long long elapsed = profileNow() - base_cycles;
+    if (ns <= 0 || elapsed == 0) return cycles;
+    return cycles * ((double)ns / elapsed);
+}
+
+static void profileFormatNs(char *buf, int buflen, double ns) {
+    if (ns < 1000) snprintf(buf, buflen, "%.0fns", ns);
+    else if (ns < 1000000) snprintf(buf, buflen, "%.1fus", ns / 1000);
+    else if (ns < 1000000000) snprintf(buf, buflen, "%.1fms", ns / 1000000);
+    else snprintf(buf, buflen, "%.2fs", ns / 1000000000);
+}
+
+/*** trace ***/
+static void profileDumpTrace(void) {
+    FILE *fp = fopen(trace_path, "w");
+    if (fp == NULL) return;
+    double rate = profileCyclesToNs(1000000) / 1000000;
+    // Outer probes are recorded after the ones nested in them, so the
+    // earliest start can be anywhere in the buffer
+    unsigned long long origin = trace_len ? trace[0].start : 0;
+    for (long i = 1; i < trace_len; i++) {
+        if (trace[i].start < origin) origin = trace[i].start;
+    }
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (long i = 0; i < trace_len; i++) {
+        struct traceEvent *ev = &trace[i];
+        fprintf(fp, "%s\n{\"name\": \"%s\", \"cat\": \"kilo\", \"ph\": \"X\", "
+                "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": 1}",
+                i ? "," : "", probe_names[ev->probe],
+                (ev->start - origin) * rate / 1000, ev->cycles * rate / 1000,
+                (int)getpid());
+    }
+    // Full histograms ride along; trace viewers ignore unknown keys
+    fprintf(fp, "\n], \"kiloHistograms\": {");
+    for (int p = 0; p < PROF_NUM_PROBES; p++) {
+        struct profileStats *st = &profile_stats[p];
+        fprintf(fp, "%s\n\"%s\": {\"count\": %lld, \"total_ns\": %.0f, "
+                "\"max_ns\": %.0f, \"buckets\": [", p ? "," : "", probe_names[p],
+                st->count, st->total * rate, st->max * rate);
+        int first = 1;
+        for (int b = 0; b < PROFILE_BUCKETS; b++) {
+            if (!st->buckets[b]) continue;
+            fprintf(fp, "%s{\"below_ns\": %.0f, \"count\": %lld}", first ? "" : ", ",
+                    (double)(2ULL << b) * rate, st->buckets[b]);
+            first = 0;
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n}}\n");
+    fclose(fp);
+}
+
+static void profileInit(void) {
+    profile_ready = 1;
+    base_cycles = profileNow();
+    base_ns = profileNs();
+    trace_path = getenv("KILO_TRACE");
+    if (trace_path && *trace_path) atexit(profileDumpTrace);
+    else trace_path = NULL;
+}
+
+/*** probes ***/
+void profileRecord(enum profileProbe probe, unsigned long long start,
+        unsigned long long cycles) {
+    if (!profile_ready) profileInit();
+    struct profileStats *st = &profile_stats[probe];
+    st->count++;
+    st->total += cycles;
+    if (cycles > st->max) st->max = cycles;
+    st->buckets[cycles ? 63 - __builtin_clzll(cycles) : 0]++;
+
+    if (probe == PROF_SYNTAX) {
+        hl_cycles += cycles;
+    } else if (probe == PROF_REFRESH) {
+        // The overlay shows what the previous frame and its keys cost
+        frame_cycles = cycles;
+        frame_hl_cycles = hl_cycles;
+        hl_cycles = 0;
+    }
+
+    if (trace_path && trace_len < PROFILE_MAX_TRACE) {
+        if (trace_len == trace_cap) {
+            trace_cap = trace_cap ? trace_cap * 2 : 4096;
+            trace = realloc(trace, sizeof(struct traceEvent) * trace_cap);
+        }
+        trace[trace_len].probe = probe;
+        trace[trace_len].start = start;
+        trace[trace_len].cycles = cycles;
+        trace_len++;
+    }
+}
+
+void profileFrame(int bytes) {
+    frame_bytes = bytes;
+}
+
+/*** reporting ***/
+void profileToggleOverlay(void) {
+    overlay_on = !overlay_on;
+}
+
+int profileOverlay(char *buf, int buflen) {
+    if (!overlay_on) return 0;
+    if (!profile_ready) profileInit();
+    char frame[16], hl[16];
+    profileFormatNs(frame, sizeof(frame), profileCyclesToNs(frame_cycles));
+    profileFormatNs(hl, sizeof(hl), profileCyclesToNs(frame_hl_cycles));
+    snprintf(buf, buflen, "frame %s | %d bytes | hl %s", frame, frame_bytes, hl);
+    return 1;
+}
+
+// Bucket upper bound below which fraction `q` of the calls finished
+static unsigned long long profilePercentile(struct profileStats *st, double q) {
+    long long want = (long long)(st->count * q);
+    long long seen = 0;
+    for (int b = 0; b < PROFILE_BUCKETS; b++) {
+        seen += st->buckets[b];
+        if (seen > want) return 2ULL << b;
+    }
+    return st->max;
+}
+
+int profileSummary(const char *name, char *buf, int buflen) {
+    for (int p = 0; p < PROF_NUM_PROBES; p++) {
+        if (strcmp(name, probe_commands[p]) != 0) continue;
+        if (!profile_ready) profileInit();
+        struct profileStats *st = &profile_stats[p];
+        char avg[16], p50[16], p99[16], max[16];
+        profileFormatNs(avg, sizeof(avg), st->count ? profileCyclesToNs(st->total / st->count) : 0);
+        profileFormatNs(p50, sizeof(p50), profileCyclesToNs(profilePercentile(st, 0.50)));
+        profileFormatNs(p99, sizeof(p99), profileCyclesToNs(profilePercentile(st, 0.99)));
+        profileFormatNs(max, sizeof(max), profileCyclesToNs(st->max));
+        snprintf(buf, buflen, "%s: %lld calls, avg %s, p50 <%s, p99 <%s, max %s",
+                probe_commands[p], st->count, avg, p50, p99, max);
+        return 1;
+    }
+    return 0;
+}
+
+#else
+
+void profileFrame(int bytes) {
+    (void)bytes;
+}
+
+void profileToggleOverlay(void) {
+    editorSetStatusMessage("Profiling is compiled out");
+}
+
+int profileOverlay(char *buf, int buflen) {
+    (void)buf;
+    (void)buflen;
+    return 0;
+}
+
+int profileSummary(const char *name, char *buf, int buflen) {
+    (void)name;
+    snprintf(buf, buflen, "Profiling is compiled out");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <time.h>
+
+/* Hot path instrumentation.
+ *
+ * PROFILE_BEGIN/PROFILE_END bracket a probe with cycle counter reads and
+ * add the result to the probe's log2 histogram. Recursive calls count
+ * once, as part of the outermost one. With KILO_TRACE set in the
+ * environment every probe is also kept as a Chrome trace event and
+ * written to that file at exit. Building with -DKILO_NO_PROFILE compiles
+ * all of it out.
+ */
+enum profileProbe {
+    PROF_REFRESH = 0,
+    PROF_SYNTAX,
+    PROF_UPDATE_ROW,
+    PROF_FIND,
+    PROF_OPEN,
+    PROF_SAVE,
+    PROF_NUM_PROBES
+};
+
+#define PROFILE_BUCKETS 64
+
+struct profileStats {
+    long long count;
+    unsigned long long total;
+    unsigned long long max;
+    long long buckets[PROFILE_BUCKETS];
+    int depth;
+};
+
+#ifdef KILO_NO_PROFILE
+
+#define PROFILE_BEGIN(probe)
+#define PROFILE_END(probe)
+#define PROFILE_FRAME(bytes)
+
+#else
+
+#define PROFILE_BEGIN(probe) \
+    unsigned long long profile_start_##probe = profileEnter(probe)
+#define PROFILE_END(probe) profileLeave(probe, profile_start_##probe)
+#define PROFILE_FRAME(bytes) profileFrame(bytes)
+
+extern struct profileStats profile_stats[PROF_NUM_PROBES];
+
+static inline unsigned long long profileNow(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline unsigned long long profileEnter(enum profileProbe probe) {
+    profile_stats[probe].depth++;
+    return profileNow();
+}
+
+void profileRecord(enum profileProbe probe, unsigned long long start,
+        unsigned long long cycles);
+
+static inline void profileLeave(enum profileProbe probe, unsigned long long start) {
+    unsigned long long cycles = profileNow() - start;
+    if (--profile_stats[probe].depth == 0) profileRecord(probe, start, cycles);
+}
+
+#endif
+
+void profileFrame(int bytes);
+
+void profileToggleOverlay(void);
+
+int profileOverlay(char *buf, int buflen);
+
+int profileSummary(const char *name, char *buf, int buflen);
+
+#endif
@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "buffer.h"
+#include "diff.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "journal.h"
+#include "memory.h"
+#include "reload.h"
+
+struct editorWatch {
+    char *path;
+    char *name;
+    int inotify_fd;
+    int timer;
+    // The file as the buffer last saw it
+    struct stat st;
+    int have_st;
+    // Our own saves in flight, their writes aren't news
+    int saving;
+};
+
+// A file split into lines, the way the loader splits it
+struct diskLines {
+    char *buf;
+    char **line;
+    int *len;
+    struct savedLines *saved;
+    int n;
+    long long bytes;
+};
+
+/*** saved lines ***/
+static void savedPush(struct savedLines *s, uint64_t h) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->hash = memRealloc(MEM_ROWS, s->hash, sizeof(uint64_t) * s->cap);
+    }
+    s->hash[s->n++] = h;
+}
+
+// Hashes of the rows as they are now
+struct savedLines *editorSavedCapture(void) {
+    struct savedLines *s = calloc(1, sizeof(struct savedLines));
+    for (int i = 0; i < E.numrows; i++) savedPush(s, diffHash(E.row[i].chars, E.row[i].size));
+    return s;
+}
+
+void editorSavedFree(struct savedLines *saved) {
+    if (!saved) return;
+    memFree(MEM_ROWS, saved->hash);
+    free(saved);
+}
+
+void editorSavedInstall(struct savedLines *saved) {
+    editorSavedFree(E.saved);
+    E.saved = saved;
+}
+
+void editorSavedAppend(const char *s, size_t len) {
+    if (!E.saved) E.saved = calloc(1, sizeof(struct savedLines));
+    savedPush(E.saved, diffHash(s, len));
+}
+
+void editorSavedSetLine(int at, const char *s, size_t len) {
+    if (E.saved && at >= 0 && at < E.saved->n) E.saved->hash[at] = diffHash(s, len);
+}
+
+/*** disk ***/
+static void diskFree(struct diskLines *d) {
+    free(d->buf);
+    free(d->line);
+    free(d->len);
+    editorSavedFree(d->saved);
+}
+
+static int diskRead(const char *path, struct diskLines *d, struct stat *st) {
+    memset(d, 0, sizeof(*d));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    // Taken before reading, so a write racing with us shows up next time
+    if (fstat(fd, st) == -1) {
+        close(fd);
+        return -1;
+    }
+    size_t cap = st->st_size + 1;
+    d->buf = malloc(cap);
+    while (1) {
+        if ((size_t)d->bytes == cap) d->buf = realloc(d->buf, cap *= 2);
+        ssize_t n = read(fd, d->buf + d->bytes, cap - d->bytes);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        d->bytes += n;
+    }
+    close(fd);
+
+    d->saved = calloc(1, sizeof(struct savedLines));
+    int cap_lines = 0;
+    char *s = d->buf;
+    char *end = d->buf + d->bytes;
+    while (s < end) {
+        char *nl = memchr(s, '\n', end - s);
+        int linelen = nl ? nl - s : end - s;
+        char *next = s + linelen + 1;
+        while (linelen > 0 && (s[linelen - 1] == '\n' || s[linelen - 1] == '\r')) linelen--;
+        if (d->n == cap_lines) {
+            cap_lines = cap_lines ? cap_lines * 2 : 1024;
+            d->line = realloc(d->line, sizeof(char *) * cap_lines);
+            d->len = realloc(d->len, sizeof(int) * cap_lines);
+        }
+        d->line[d->n] = s;
+        d->len[d->n] = linelen;
+        savedPush(d->saved, diffHash(s, linelen));
+        d->n++;
+        s = next;
+    }
+    return 0;
+}
+
+void editorSavedFromFile(const char *path) {
+    struct diskLines d;
+    struct stat st;
+    if (diskRead(path, &d, &st) == 0) {
+        editorSavedInstall(d.saved);
+        d.saved = NULL;
+    } else {
+        editorSavedInstall(NULL);
+    }
+    diskFree(&d);
+}
+
+/*** merging ***/
+// Where a row at pos ends up once rows [at, at + del) became ins rows
+static int reloadShift(int pos, int at, int del, int ins) {
+    if (pos >= at + del) return pos + ins - del;
+    if (pos >= at + ins) return ins ? at + ins - 1 : at;
+    return pos;
+}
+
+static void reloadApplyHunk(int at, int del, struct diskLines *d, int from, int ins) {
+    int pair = del < ins ? del : ins;
+    for (int i = 0; i < pair; i++) {
+        erow *row = &E.row[at + i];
+        editorRowTruncate(row, 0);
+        editorRowAppendString(row, d->line[from + i], d->len[from + i]);
+    }
+    for (int i = pair; i < del; i++) editorDelRow(at + pair);
+    for (int i = pair; i < ins; i++) editorInsertRow(at + i, d->line[from + i], d->len[from + i]);
+    E.cy = reloadShift(E.cy, at, del, ins);
+    E.rowoff = reloadShift(E.rowoff, at, del, ins);
+}
+
+// Does a disk hunk touch lines the user changed too?
+static int reloadConflict(struct diffHunk *disk, struct diffHunk *user) {
+    int a0 = disk->a_start, a1 = disk->a_start + disk->a_len;
+    int u0 = user->a_start, u1 = user->a_start + user->a_len;
+    if (a0 < u1 && u0 < a1) return 1;
+    if (disk->a_len == 0 && u0 <= a0 && a0 <= u1) return 1;
+    if (user->a_len == 0 && a0 <= u0 && u0 <= a1) return 1;
+    return 0;
+}
+
+// Bring the buffer up to date with the file on disk. Returns how many
+// hunks differed, or -1 if the file can't be read.
+int editorReload(void) {
+    if (!E.filename) return -1;
+    struct diskLines d;
+    struct stat st;
+    if (diskRead(E.filename, &d, &st) == -1) {
+        editorSetStatusMessage("Can't reload %s: %s", E.filename, strerror(errno));
+        diskFree(&d);
+        return -1;
+    }
+    if (E.watch) {
+        E.watch->st = st;
+        E.watch->have_st = 1;
+    }
+
+    struct savedLines none = {NULL, 0, 0};
+    struct savedLines *saved = E.saved ? E.saved : &none;
+    struct diffHunk *hunks;
+    int nhunks = diffLines(saved->hash, saved->n, d.saved->hash, d.n, &hunks);
+
+    // With unsaved edits, find them the same way and stay out of their way
+    struct diffHunk *user = NULL;
+    int nuser = 0;
+    if (E.dirty && nhunks) {
+        struct savedLines *rows = editorSavedCapture();
+        nuser = diffLines(saved->hash, saved->n, rows->hash, rows->n, &user);
+        editorSavedFree(rows);
+    }
+
+    // Buffer row of each hunk, -1 for the ones kept as the user has them
+    int *at = malloc(sizeof(int) * (nhunks ? nhunks : 1));
+    int conflicts = 0;
+    int u = 0, shift = 0;
+    for (int i = 0; i < nhunks; i++) {
+        while (u < nuser && user[u].a_start + user[u].a_len <= hunks[i].a_start &&
+                !reloadConflict(&hunks[i], &user[u])) {
+            shift += user[u].b_len - user[u].a_len;
+            u++;
+        }
+        at[i] = hunks[i].a_start + shift;
+        for (int k = u; k < nuser && user[k].a_start <= hunks[i].a_start + hunks[i].a_len; k++) {
+            if (reloadConflict(&hunks[i], &user[k])) {
+                at[i] = -1;
+                conflicts++;
+                break;
+            }
+        }
+    }
+
+    // Bottom up, so the rows of the hunks still to come don't move
+    int dirty = E.dirty;
+    journalSuspend();
+    for (int i = nhunks - 1; i >= 0; i--) {
+        if (at[i] == -1) continue;
+        reloadApplyHunk(at[i], hunks[i].a_len, &d, hunks[i].b_start, hunks[i].b_len);
+    }
+    journalResume();
+    E.dirty = dirty;
+
+    if (E.cy > E.numrows) E.cy = E.numrows;
+    if (E.rowoff > E.cy) E.rowoff = E.cy;
+    if (E.cy < E.numrows && E.cx > E.row[E.cy].size) E.cx = E.row[E.cy].size;
+
+    editorSavedInstall(d.saved);
+    d.saved = NULL;
+    E.file_bytes = d.bytes;
+    // The journal was relative to the old file
+    if (E.journal && nhunks) {
+        if (E.dirty) journalCheckpoint(E.journal);
+        else journalRebase(E.journal);
+    }
+
+    int applied = nhunks - conflicts;
+    if (conflicts) {
+        editorSetStatusMessage("%s changed on disk: merged %d hunks, kept your version of %d",
+                E.filename, applied, conflicts);
+    } else if (nhunks) {
+        editorSetStatusMessage("%s changed on disk: merged %d hunks", E.filename, applied);
+    }
+    if (nhunks) eventLoopRequestRedraw();
+    free(at);
+    free(user);
+    free(hunks);
+    diskFree(&d);
+    return nhunks;
+}
+
+/*** watching ***/
+static int reloadSameFile(struct stat *a, struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+        a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static void editorWatchCheck(void *arg) {
+    struct editorWatch *w = arg;
+    int prev = bufferEnter(offsetof(struct editorConfig, watch), w);
+    if (prev == -1) return;
+    struct stat st;
+    if (E.follow) {
+        // Follow mode reads the file itself
+    } else if (E.loader || w->saving) {
+        // Rows still loading or our own write still going: look again later
+        eventLoopArmTimer(w->timer, KILO_WATCH_DELAY, 0);
+    } else if (stat(w->path, &st) == 0 && !(w->have_st && reloadSameFile(&st, &w->st))) {
+        // A file that is gone for now comes back with another event
+        editorReload();
+    }
+    bufferLeave(prev);
+}
+
+static void editorWatchEvent(int fd, void *arg) {
+    struct editorWatch *w = arg;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    int ours = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            if (ev->len && !strcmp(ev->name, w->name)) ours = 1;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    // Writers come in bursts, look once they are done
+    if (ours) eventLoopArmTimer(w->timer, KILO_WATCH_DELAY, 0);
+}
+
+// Watch E.filename, taking the file as it is now as the one in the buffer
+void editorWatchStart(void) {
+    if (!E.filename) return;
+    struct editorWatch *w = E.watch;
+    if (w && strcmp(w->path, E.filename)) {
+        editorWatchStop();
+        w = NULL;
+    }
+    if (!w) {
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd == -1) return;
+        w = calloc(1, sizeof(struct editorWatch));
+        w->path = strdup(E.filename);
+        char *copy = strdup(E.filename);
+        w->name = strdup(basename(copy));
+        free(copy);
+        copy = strdup(E.filename);
+        // The directory sees writes in place as well as renames into place
+        inotify_add_watch(fd, dirname(copy), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                IN_CREATE | IN_MOVED_TO);
+        free(copy);
+        w->inotify_fd = fd;
+        w->timer = eventLoopAddTimer(editorWatchCheck, w);
+        eventLoopAddFd(fd, editorWatchEvent, w);
+        E.watch = w;
+    }
+    w->have_st = stat(w->path, &w->st) == 0;
+}
+
+void editorWatchStop(void) {
+    struct editorWatch *w = E.watch;
+    if (!w) return;
+    E.watch = NULL;
+    eventLoopRemoveFd(w->inotify_fd);
+    eventLoopRemoveTimer(w->timer);
+    close(w->inotify_fd);
+    free(w->path);
+    free(w->name);
+    free(w);
+}
+
+void editorWatchSaveBegin(void) {
+    if (E.watch) E.watch->saving++;
+}
+
+// Our save is on disk: that is the file the buffer knows now
+void editorWatchSaveEnd(int saved) {
+    if (E.watch) E.watch->saving--;
+    if (saved) editorWatchStart();
+}
@@ -0,0 +1,46 @@
+#ifndef RELOAD_H_
+#define RELOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Noticing and merging changes other programs make to the file.
+ *
+ * E.saved holds a hash per line of the file as it was last read or
+ * written. inotify on the file and its directory, confirmed by mtime,
+ * size and inode, tells when it changed on disk. The new contents are
+ * then diffed against E.saved and only the changed hunks are applied as
+ * row edits, so every other row keeps its highlighting and the view
+ * stays put. Hunks that overlap unsaved edits are left alone.
+ */
+struct savedLines {
+    uint64_t *hash;
+    int n;
+    int cap;
+};
+
+struct editorWatch;
+
+struct savedLines *editorSavedCapture(void);
+
+void editorSavedInstall(struct savedLines *saved);
+
+void editorSavedFree(struct savedLines *saved);
+
+void editorSavedAppend(const char *s, size_t len);
+
+void editorSavedSetLine(int at, const char *s, size_t len);
+
+void editorSavedFromFile(const char *path);
+
+void editorWatchStart(void);
+
+void editorWatchStop(void);
+
+void editorWatchSaveBegin(void);
+
+void editorWatchSaveEnd(int saved);
+
+int editorReload(void);
+
+#endif
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "terminal.h"
+#include "rowalloc.h"
+
+struct rowSlab {
+    struct rowSlab *prev;
+    struct rowSlab *next;
+    int size_class;
+    size_t bytes;
+    char *bump;
+    char *end;
+};
+
+struct rowChunk {
+    struct rowChunk *next;
+    char *base;
+};
+
+#define ROW_LARGE_CLASS -1
+#define ROW_CHUNK_SIZE (64 * ROW_SLAB_SIZE)
+#define ROW_SLAB_HEADER ((sizeof(struct rowSlab) + 63) & ~(size_t)63)
+#define ROW_CLASS_SIZE(c) (classSizes[c])
+
+// 16 byte steps up to 128, then four classes per power of two, so rounding
+// never wastes more than a fifth of a block
+static const size_t classSizes[ROW_NUM_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+    2560, 3072, 3584, 4096,
+};
+
+/*** slabs ***/
+static struct rowSlab *slabOf(void *p) {
+    return (struct rowSlab *)((uintptr_t)p & ~(uintptr_t)(ROW_SLAB_SIZE - 1));
+}
+
+static int sizeClass(size_t size) {
+    if (size <= 128) return size ? (size - 1) / 16 : 0;
+    if (size > ROW_MAX_CLASS) return ROW_LARGE_CLASS;
+    // Position of the top bit picks the power of two, the next two bits
+    // pick the quarter within it
+    int bit = 63 - __builtin_clzll((unsigned long long)(size - 1));
+    int quarter = ((size - 1) >> (bit - 2)) & 3;
+    return 8 + (bit - 7) * 4 + quarter;
+}
+
+// Slabs are cut from slab-aligned chunks mapped straight from the kernel,
+// so aligning them costs no memory and freeing them is one munmap per chunk
+static char *chunkNew(struct rowArena *arena) {
+    size_t len = ROW_CHUNK_SIZE + ROW_SLAB_SIZE;
+    char *mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) die("mmap");
+    char *base = (char *)(((uintptr_t)mem + ROW_SLAB_SIZE - 1) &
+            ~(uintptr_t)(ROW_SLAB_SIZE - 1));
+    if (base > mem) munmap(mem, base - mem);
+    munmap(base + ROW_CHUNK_SIZE, (mem + len) - (base + ROW_CHUNK_SIZE));
+
+    struct rowChunk *chunk = malloc(sizeof(struct rowChunk));
+    if (chunk == NULL) die("malloc");
+    chunk->base = base;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->chunk_next = base;
+    arena->chunk_end = base + ROW_CHUNK_SIZE;
+    return base;
+}
+
+static struct rowSlab *slabNew(struct rowArena *arena, int size_class, size_t bytes) {
+    void *mem;
+    if (size_class == ROW_LARGE_CLASS) {
+        if (posix_memalign(&mem, ROW_SLAB_SIZE, bytes) != 0) die("posix_memalign");
+        // Only large blocks are freed one by one, so only they are linked
+        struct rowSlab *large = mem;
+        large->prev = NULL;
+        large->next = arena->large;
+        if (arena->large) arena->large->prev = large;
+        arena->large = large;
+    } else {
+        if (arena->chunk_next == arena->chunk_end) chunkNew(arena);
+        mem = arena->chunk_next;
+        arena->chunk_next += ROW_SLAB_SIZE;
+    }
+    struct rowSlab *slab = mem;
+    slab->size_class = size_class;
+    slab->bytes = bytes;
+    slab->bump = (char *)slab + ROW_SLAB_HEADER;
+    slab->end = (char *)slab + bytes;
+    arena->reserved_bytes += bytes;
+    if (size_class == ROW_LARGE_CLASS) arena->num_large++;
+    else arena->num_slabs++;
+    return slab;
+}
+
+static void slabUnlink(struct rowArena *arena, struct rowSlab *slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else arena->large = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+}
+
+size_t rowBlockSize(void *p) {
+    struct rowSlab *slab = slabOf(p);
+    if (slab->size_class == ROW_LARGE_CLASS) return slab->bytes - ROW_SLAB_HEADER;
+    return ROW_CLASS_SIZE(slab->size_class);
+}
+
+/*** arenas ***/
+struct rowArena *rowArenaNew(void) {
+    struct rowArena *arena = calloc(1, sizeof(struct rowArena));
+    if (arena == NULL) die("calloc");
+    return arena;
+}
+
+// Drop every block in one pass over the slabs, without touching the rows
+void rowArenaReset(struct rowArena *arena) {
+    struct rowSlab *slab = arena->large;
+    while (slab) {
+        struct rowSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    struct rowChunk *chunk = arena->chunks;
+    while (chunk) {
+        struct rowChunk *next = chunk->next;
+        munmap(chunk->base, ROW_CHUNK_SIZE);
+        free(chunk);
+        chunk = next;
+    }
+    memset(arena, 0, sizeof(struct rowArena));
+}
+
+void rowArenaFree(struct rowArena *arena) {
+    if (!arena) return;
+    rowArenaReset(arena);
+    free(arena);
+}
+
+/*** allocation ***/
+void *rowAlloc(struct rowArena *arena, size_t size) {
+    int c = sizeClass(size);
+    if (c == ROW_LARGE_CLASS) {
+        struct rowSlab *slab = slabNew(arena, c, ROW_SLAB_HEADER + size);
+        arena->live_bytes += size;
+        arena->live_objects++;
+        return (char *)slab + ROW_SLAB_HEADER;
+    }
+
+    size_t csize = ROW_CLASS_SIZE(c);
+    void *p = arena->free_list[c];
+    if (p) {
+        arena->free_list[c] = *(void **)p;
+        arena->free_count[c]--;
+    } else {
+        struct rowSlab *slab = arena->current[c];
+        if (!slab || slab->bump + csize > slab->end) {
+            slab = slabNew(arena, c, ROW_SLAB_SIZE);
+            arena->current[c] = slab;
+        }
+        p = slab->bump;
+        slab->bump += csize;
+    }
+    arena->live_bytes += csize;
+    arena->live_objects++;
+    return p;
+}
+
+void rowFree(struct rowArena *arena, void *p) {
+    if (!p) return;
+    struct rowSlab *slab = slabOf(p);
+    arena->live_objects--;
+    if (slab->size_class == ROW_LARGE_CLASS) {
+        arena->live_bytes -= slab->bytes - ROW_SLAB_HEADER;
+        arena->reserved_bytes -= slab->bytes;
+        arena->num_large--;
+        slabUnlink(arena, slab);
+        free(slab);
+        return;
+    }
+    int c = slab->size_class;
+    arena->live_bytes -= ROW_CLASS_SIZE(c);
+    *(void **)p = arena->free_list[c];
+    arena->free_list[c] = p;
+    arena->free_count[c]++;
+}
+
+void *rowRealloc(struct rowArena *arena, void *p, size_t size) {
+    if (!p) return rowAlloc(arena, size);
+    size_t old = rowBlockSize(p);
+    int large = slabOf(p)->size_class == ROW_LARGE_CLASS;
+    // Growing within the size class is free, which covers most keystrokes
+    if (size <= old && (!large || size * 2 > old)) return p;
+    // Large rows grow geometrically so typing into them stays amortized O(1)
+    size_t want = size;
+    if (large && size > old && want < old + old / 2) want = old + old / 2;
+    void *new = rowAlloc(arena, want);
+    memcpy(new, p, old < size ? old : size);
+    rowFree(arena, p);
+    return new;
+}
+
+/*** stats ***/
+void rowArenaGetStats(struct rowArena *arena, struct rowArenaStats *st) {
+    st->live_bytes = arena->live_bytes;
+    st->free_bytes = 0;
+    for (int c = 0; c < ROW_NUM_CLASSES; c++) {
+        st->free_bytes += arena->free_count[c] * ROW_CLASS_SIZE(c);
+    }
+    st->reserved_bytes = arena->reserved_bytes;
+    st->live_objects = arena->live_objects;
+    st->slabs = arena->num_slabs;
+    st->large = arena->num_large;
+    st->fragmentation = 0;
+    if (st->reserved_bytes) {
+        st->fragmentation = (int)((st->reserved_bytes - st->live_bytes) * 100 /
+                st->reserved_bytes);
+    }
+}
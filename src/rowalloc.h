@@ -0,0 +1,66 @@
+#ifndef ROWALLOC_H_
+#define ROWALLOC_H_
+
+#include <stddef.h>
+
+#include "memory.h"
+
+/* Size-class slab allocator for row payloads (chars, render, hl).
+ *
+ * Small blocks are carved out of 64K slabs, one size class per slab, and
+ * recycled through per-class free lists. Slabs are cut from 4M chunks
+ * mapped from the kernel. Blocks larger than the biggest class get a slab
+ * of their own. Every block can find its slab header by
+ * masking its address, so frees and reallocs don't need the old size, and
+ * dropping a whole buffer is one pass over its slabs.
+ */
+#define ROW_SLAB_SIZE (64 * 1024)
+#define ROW_MAX_CLASS 4096
+#define ROW_NUM_CLASSES 28
+
+struct rowSlab;
+struct rowChunk;
+
+struct rowArena {
+    struct rowChunk *chunks;
+    char *chunk_next;
+    char *chunk_end;
+    struct rowSlab *large;
+    struct rowSlab *current[ROW_NUM_CLASSES];
+    void *free_list[ROW_NUM_CLASSES];
+    long free_count[ROW_NUM_CLASSES];
+    size_t live_bytes;
+    size_t reserved_bytes;
+    long live_objects;
+    long num_slabs;
+    long num_large;
+    size_t tag_bytes[MEM_NUM_TAGS];
+};
+
+struct rowArenaStats {
+    size_t live_bytes;
+    size_t free_bytes;
+    size_t reserved_bytes;
+    long live_objects;
+    long slabs;
+    long large;
+    int fragmentation;
+};
+
+struct rowArena *rowArenaNew(void);
+
+void rowArenaFree(struct rowArena *arena);
+
+void rowArenaReset(struct rowArena *arena);
+
+void *rowAlloc(struct rowArena *arena, size_t size);
+
+void *rowRealloc(struct rowArena *arena, void *p, size_t size);
+
+void rowFree(struct rowArena *arena, void *p);
+
+size_t rowBlockSize(void *p);
+
+void rowArenaGetStats(struct rowArena *arena, struct rowArenaStats *st);
+
+#endif
@@ -0,0 +1,324 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "buffer.h"
+#include "draw.h"
+#include "editor.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "follow.h"
+#include "server.h"
+#include "userinput.h"
+#include "view.h"
+
+#define MSG_HEADER 5
+
+struct serverClient {
+    int fd;
+    // Terminal size, once it said hello
+    int attached;
+    int rows;
+    int cols;
+    struct msgReader in;
+};
+
+static struct serverClient **clients = NULL;
+static int nclients = 0;
+static int listen_fd = -1;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+/*** messages ***/
+// Send a whole message, -1 if the peer is gone or stopped reading
+int msgSend(int fd, int type, const char *payload, int len) {
+    char *buf = malloc(MSG_HEADER + len);
+    buf[0] = type;
+    buf[1] = (len >> 24) & 0xff;
+    buf[2] = (len >> 16) & 0xff;
+    buf[3] = (len >> 8) & 0xff;
+    buf[4] = len & 0xff;
+    memcpy(&buf[MSG_HEADER], payload, len);
+    int sent = 0, total = MSG_HEADER + len;
+    while (sent < total) {
+        int n = send(fd, &buf[sent], total - sent, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sent += n;
+    }
+    free(buf);
+    return sent == total ? 0 : -1;
+}
+
+// Read whatever fd has without blocking. 0 once the peer hung up, -1 on
+// errors.
+int msgFill(int fd, struct msgReader *r) {
+    if (r->pos > 0) {
+        memmove(r->buf, &r->buf[r->pos], r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+    }
+    while (1) {
+        if (r->len == r->cap) {
+            r->cap = r->cap ? r->cap * 2 : 4096;
+            r->buf = realloc(r->buf, r->cap);
+        }
+        int n = recv(fd, &r->buf[r->len], r->cap - r->len, MSG_DONTWAIT);
+        if (n > 0) {
+            r->len += n;
+        } else if (n == 0) {
+            return 0;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 1;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Take the next complete message. Its payload stays valid until the
+// next msgFill. -1 for one longer than KILO_MESSAGE_MAX.
+int msgNext(struct msgReader *r, struct msg *m) {
+    if (r->len - r->pos < MSG_HEADER) return 0;
+    unsigned char *h = (unsigned char *)&r->buf[r->pos];
+    unsigned long len = ((unsigned long)h[1] << 24) | (h[2] << 16) | (h[3] << 8) | h[4];
+    if (len > KILO_MESSAGE_MAX) return -1;
+    if (r->len - r->pos < MSG_HEADER + (int)len) return 0;
+    m->type = h[0];
+    m->payload = &r->buf[r->pos + MSG_HEADER];
+    m->len = len;
+    r->pos += MSG_HEADER + len;
+    return 1;
+}
+
+void msgFree(struct msgReader *r) {
+    free(r->buf);
+    r->buf = NULL;
+    r->len = r->pos = r->cap = 0;
+}
+
+/*** socket ***/
+// $KILO_SOCKET, else kilo.sock in $XDG_RUNTIME_DIR, else in a directory
+// of /tmp only the user may use
+static int serverAddress(struct sockaddr_un *addr) {
+    int size = sizeof(addr->sun_path), len;
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    const char *path = getenv("KILO_SOCKET");
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (path && *path) {
+        len = snprintf(addr->sun_path, size, "%s", path);
+    } else if (runtime && *runtime) {
+        len = snprintf(addr->sun_path, size, "%s/kilo.sock", runtime);
+    } else {
+        char dir[64];
+        struct stat st;
+        snprintf(dir, sizeof(dir), "/tmp/kilo-%d", (int)getuid());
+        if (mkdir(dir, 0700) == -1 && errno != EEXIST) return -1;
+        if (lstat(dir, &st) == -1) return -1;
+        if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)) {
+            errno = EACCES;
+            return -1;
+        }
+        len = snprintf(addr->sun_path, size, "%s/kilo.sock", dir);
+    }
+    if (len >= size) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+// A socket connected to the running daemon, or -1 if there is none
+int serverConnect(void) {
+    struct sockaddr_un addr;
+    if (serverAddress(&addr) == -1) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// Listen where clients will look. Fails with EADDRINUSE while another
+// daemon is running; a socket left behind by one that died is replaced.
+int serverBind(void) {
+    struct sockaddr_un addr;
+    if (serverAddress(&addr) == -1) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    int code = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (code == -1 && errno == EADDRINUSE) {
+        int probe = serverConnect();
+        if (probe != -1) {
+            close(probe);
+            errno = EADDRINUSE;
+        } else {
+            unlink(addr.sun_path);
+            code = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        }
+    }
+    if (code == -1 || listen(fd, 8) == -1) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    memcpy(socket_path, addr.sun_path, sizeof(socket_path));
+    return fd;
+}
+
+/*** clients ***/
+// Size the session for the smallest terminal attached
+static void serverRelayout(void) {
+    int rows = 0, cols = 0;
+    for (int i = 0; i < nclients; i++) {
+        if (!clients[i]->attached) continue;
+        if (!rows || clients[i]->rows < rows) rows = clients[i]->rows;
+        if (!cols || clients[i]->cols < cols) cols = clients[i]->cols;
+    }
+    if (rows && (rows != viewTermRows() || cols != viewTermCols())) editorResize(rows, cols);
+}
+
+static void serverDrop(struct serverClient *c) {
+    int at = 0;
+    while (at < nclients && clients[at] != c) at++;
+    if (at == nclients) return;
+    memmove(&clients[at], &clients[at + 1], sizeof(struct serverClient *) * (nclients - at - 1));
+    nclients--;
+    eventLoopRemoveFd(c->fd);
+    close(c->fd);
+    msgFree(&c->in);
+    free(c);
+    serverRelayout();
+}
+
+// "rows cols follow", then the files to show, the first one on top
+static void serverHello(struct serverClient *c, const struct msg *m) {
+    int follow = 0;
+    if (m->len == 0 || m->payload[m->len - 1] != '\0') return;
+    if (sscanf(m->payload, "%d %d %d", &c->rows, &c->cols, &follow) < 2) return;
+    c->attached = 1;
+
+    int first = -1;
+    const char *name = m->payload + strlen(m->payload) + 1;
+    for (; name < m->payload + m->len; name += strlen(name) + 1) {
+        int at = bufferOpen(name);
+        if (first != -1) continue;
+        first = at;
+        if (follow && editorFollowStart() == -1) {
+            editorSetStatusMessage("Can't follow %s: %s", name, strerror(errno));
+        }
+    }
+    if (first != -1) bufferSwitch(first);
+
+    int attached = 0;
+    for (int i = 0; i < nclients; i++) attached += clients[i]->attached;
+    if (attached > 1) editorSetStatusMessage("%d terminals share this session", attached);
+    // Whatever the terminal showed before goes, everything is sent again
+    msgSend(c->fd, MSG_OUTPUT, "\x1b[2J", 4);
+    serverRelayout();
+    editorInvalidateFrame();
+    eventLoopRequestRedraw();
+}
+
+static void serverClientInput(int fd, void *arg) {
+    struct serverClient *c = arg;
+    int open = msgFill(fd, &c->in);
+    struct msg m;
+    int next;
+    while ((next = msgNext(&c->in, &m)) > 0) {
+        if (m.type == MSG_HELLO) {
+            serverHello(c, &m);
+        } else if (m.type == MSG_INPUT && c->attached) {
+            editorFeedInput(m.payload, m.len, fd);
+        } else if (m.type == MSG_RESIZE && c->attached && m.len > 0 &&
+                m.payload[m.len - 1] == '\0') {
+            sscanf(m.payload, "%d %d", &c->rows, &c->cols);
+            serverRelayout();
+        }
+    }
+    if (open <= 0 || next == -1) serverDrop(c);
+}
+
+static void serverAccept(int fd, void *arg) {
+    (void)arg;
+    int client = accept(fd, NULL, NULL);
+    if (client == -1) return;
+    // Writes block, but only so long for a terminal that stopped reading
+    struct timeval tv;
+    tv.tv_sec = KILO_CLIENT_TIMEOUT / 1000;
+    tv.tv_usec = (KILO_CLIENT_TIMEOUT % 1000) * 1000;
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    struct serverClient *c = calloc(1, sizeof(struct serverClient));
+    c->fd = client;
+    clients = realloc(clients, sizeof(struct serverClient *) * (nclients + 1));
+    clients[nclients++] = c;
+    eventLoopAddFd(client, serverClientInput, c);
+}
+
+// Every attached terminal gets the same bytes. One that can't take them
+// is shut down, and dropped once its handler sees that.
+static void serverBroadcast(const char *s, int len) {
+    for (int i = 0; i < nclients; i++) {
+        if (!clients[i]->attached) continue;
+        for (int sent = 0; sent < len; sent += KILO_MESSAGE_MAX) {
+            int n = len - sent < KILO_MESSAGE_MAX ? len - sent : KILO_MESSAGE_MAX;
+            if (msgSend(clients[i]->fd, MSG_OUTPUT, &s[sent], n) == -1) {
+                shutdown(clients[i]->fd, SHUT_RDWR);
+                break;
+            }
+        }
+    }
+}
+
+/*** daemon ***/
+static void serverStop(void) {
+    for (int i = 0; i < nclients; i++) close(clients[i]->fd);
+    nclients = 0;
+    if (listen_fd != -1) unlink(socket_path);
+}
+
+// Unsaved changes stay in their journals for the next start to recover
+static void serverTerminate(int signo) {
+    (void)signo;
+    exit(0);
+}
+
+// Serve clients on listen_fd from the event loop; frames go to them
+// from now on
+void serverStart(int fd) {
+    listen_fd = fd;
+    eventLoopAddFd(listen_fd, serverAccept, NULL);
+    editorSetOutput(serverBroadcast);
+    eventLoopAddSignal(SIGTERM, serverTerminate);
+    atexit(serverStop);
+}
+
+int serverActive(void) {
+    return listen_fd != -1;
+}
+
+// Let go of the client that sent the key being handled. It sees the
+// socket close and gives its terminal back.
+void serverDetach(void) {
+    for (int i = 0; i < nclients; i++) {
+        if (clients[i]->fd == editorInputSource()) {
+            serverDrop(clients[i]);
+            return;
+        }
+    }
+}
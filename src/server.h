@@ -0,0 +1,60 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+/* Resident editor daemon.
+ *
+ * kilo --daemon keeps its buffers, with their rows and highlighting, in a
+ * process that outlives any terminal. Clients attach through a Unix
+ * socket, private to the user, and everything crosses it as messages: a
+ * type byte, a four byte big-endian length and the payload. A client says
+ * hello with its size and the files it wants, then sends the keys it
+ * reads; the daemon sends back what it would have written to a terminal.
+ *
+ * Every client attached sees the same screen, sized to the smallest of
+ * them, and any of them can type. Ctrl-Q detaches the client it came
+ * from, the buffers stay open for the next one.
+ */
+enum serverMessage {
+    // "rows cols follow", then the absolute name of each file, all
+    // NUL terminated
+    MSG_HELLO = 1,
+    // Bytes read from the terminal
+    MSG_INPUT,
+    // "rows cols"
+    MSG_RESIZE,
+    // Bytes for the terminal
+    MSG_OUTPUT,
+};
+
+struct msgReader {
+    char *buf;
+    int len;
+    int pos;
+    int cap;
+};
+
+struct msg {
+    int type;
+    const char *payload;
+    int len;
+};
+
+int msgSend(int fd, int type, const char *payload, int len);
+
+int msgFill(int fd, struct msgReader *r);
+
+int msgNext(struct msgReader *r, struct msg *m);
+
+void msgFree(struct msgReader *r);
+
+int serverConnect(void);
+
+int serverBind(void);
+
+void serverStart(int listen_fd);
+
+int serverActive(void);
+
+void serverDetach(void);
+
+#endif
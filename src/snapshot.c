@@ -0,0 +1,369 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "terminal.h"
+#include "memory.h"
+#include "snapshot.h"
+
+/*** accounting ***/
+static long snap_nodes = 0;
+static long snap_lines = 0;
+static long long snap_node_bytes = 0;
+static long long snap_line_bytes = 0;
+static int snap_outstanding = 0;
+
+#define SNAP_ADD(var, n) __atomic_add_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define SNAP_LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+/*** lines ***/
+static struct snapLine *lineNew(const char *s, size_t len) {
+    struct snapLine *l = memAlloc(MEM_SNAPSHOT, sizeof(struct snapLine) + len);
+    l->refs = 1;
+    l->len = len;
+    memcpy(l->data, s, len);
+    SNAP_ADD(snap_lines, 1);
+    SNAP_ADD(snap_line_bytes, (long long)(sizeof(struct snapLine) + len));
+    return l;
+}
+
+static void lineRetain(struct snapLine *l) {
+    __atomic_add_fetch(&l->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void lineRelease(struct snapLine *l) {
+    if (__atomic_sub_fetch(&l->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    SNAP_ADD(snap_lines, -1);
+    SNAP_ADD(snap_line_bytes, -(long long)(sizeof(struct snapLine) + l->len));
+    memFree(MEM_SNAPSHOT, l);
+}
+
+/*** nodes ***/
+static struct snapNode *nodeNew(int leaf) {
+    struct snapNode *n = memAlloc(MEM_SNAPSHOT, sizeof(struct snapNode));
+    memset(n, 0, sizeof(struct snapNode));
+    n->refs = 1;
+    n->leaf = leaf;
+    SNAP_ADD(snap_nodes, 1);
+    SNAP_ADD(snap_node_bytes, (long long)sizeof(struct snapNode));
+    return n;
+}
+
+static void nodeRetain(struct snapNode *n) {
+    __atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void nodeRelease(struct snapNode *n) {
+    if (__atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+    for (int i = 0; i < n->count; i++) {
+        if (n->leaf) lineRelease(n->slots[i]);
+        else nodeRelease(n->slots[i]);
+    }
+    SNAP_ADD(snap_nodes, -1);
+    SNAP_ADD(snap_node_bytes, -(long long)sizeof(struct snapNode));
+    memFree(MEM_SNAPSHOT, n);
+}
+
+// Return a node that only the live tree references, copying it if a
+// snapshot still holds it. The copy shares all of the original's children.
+static struct snapNode *nodeUnique(struct snapNode *n) {
+    if (__atomic_load_n(&n->refs, __ATOMIC_ACQUIRE) == 1) return n;
+    struct snapNode *copy = nodeNew(n->leaf);
+    copy->count = n->count;
+    copy->nlines = n->nlines;
+    copy->nbytes = n->nbytes;
+    memcpy(copy->slots, n->slots, sizeof(void *) * n->count);
+    for (int i = 0; i < n->count; i++) {
+        if (n->leaf) lineRetain(n->slots[i]);
+        else nodeRetain(n->slots[i]);
+    }
+    nodeRelease(n);
+    return copy;
+}
+
+static void nodeRecount(struct snapNode *n) {
+    n->nlines = 0;
+    n->nbytes = 0;
+    for (int i = 0; i < n->count; i++) {
+        if (n->leaf) {
+            n->nlines++;
+            n->nbytes += ((struct snapLine *)n->slots[i])->len + 1;
+        } else {
+            struct snapNode *child = n->slots[i];
+            n->nlines += child->nlines;
+            n->nbytes += child->nbytes;
+        }
+    }
+}
+
+static struct snapNode *nodeSplit(struct snapNode *n) {
+    struct snapNode *right = nodeNew(n->leaf);
+    int half = n->count / 2;
+    right->count = n->count - half;
+    memcpy(right->slots, &n->slots[half], sizeof(void *) * right->count);
+    n->count = half;
+    nodeRecount(n);
+    nodeRecount(right);
+    return right;
+}
+
+// Find the child holding line `*at` and rebase `*at` onto that child.
+static int nodeChildFor(struct snapNode *n, int *at, int inserting) {
+    int i;
+    for (i = 0; i < n->count; i++) {
+        struct snapNode *child = n->slots[i];
+        if (*at < child->nlines || (inserting && *at == child->nlines &&
+                    i == n->count - 1)) {
+            return i;
+        }
+        *at -= child->nlines;
+    }
+    return -1;
+}
+
+/*** tree edits ***/
+static struct snapNode *nodeInsert(struct snapNode *n, int at, struct snapLine *l) {
+    struct snapNode *split = NULL;
+    if (n->leaf) {
+        memmove(&n->slots[at + 1], &n->slots[at], sizeof(void *) * (n->count - at));
+        n->slots[at] = l;
+        n->count++;
+        n->nlines++;
+        n->nbytes += l->len + 1;
+    } else {
+        int i = nodeChildFor(n, &at, 1);
+        struct snapNode *child = nodeUnique(n->slots[i]);
+        n->slots[i] = child;
+        struct snapNode *childsplit = nodeInsert(child, at, l);
+        n->nlines++;
+        n->nbytes += l->len + 1;
+        if (childsplit) {
+            memmove(&n->slots[i + 2], &n->slots[i + 1],
+                    sizeof(void *) * (n->count - i - 1));
+            n->slots[i + 1] = childsplit;
+            n->count++;
+        }
+    }
+    if (n->count == SNAP_FANOUT) split = nodeSplit(n);
+    return split;
+}
+
+static void nodeDelete(struct snapNode *n, int at) {
+    if (n->leaf) {
+        struct snapLine *l = n->slots[at];
+        n->nbytes -= l->len + 1;
+        lineRelease(l);
+        memmove(&n->slots[at], &n->slots[at + 1], sizeof(void *) * (n->count - at - 1));
+        n->count--;
+        n->nlines--;
+        return;
+    }
+    int i = nodeChildFor(n, &at, 0);
+    struct snapNode *child = nodeUnique(n->slots[i]);
+    n->slots[i] = child;
+    long long before = child->nbytes;
+    nodeDelete(child, at);
+    n->nlines--;
+    n->nbytes -= before - child->nbytes;
+    if (child->count == 0) {
+        nodeRelease(child);
+        memmove(&n->slots[i], &n->slots[i + 1], sizeof(void *) * (n->count - i - 1));
+        n->count--;
+    }
+}
+
+static void nodeSet(struct snapNode *n, int at, struct snapLine *l) {
+    if (n->leaf) {
+        struct snapLine *old = n->slots[at];
+        n->nbytes += l->len - old->len;
+        lineRelease(old);
+        n->slots[at] = l;
+        return;
+    }
+    int i = nodeChildFor(n, &at, 0);
+    struct snapNode *child = nodeUnique(n->slots[i]);
+    n->slots[i] = child;
+    long long before = child->nbytes;
+    nodeSet(child, at, l);
+    n->nbytes += child->nbytes - before;
+}
+
+/*** live tree ***/
+// The live tree is only built once somebody asks for a snapshot; until
+// then the row operations below are no-ops and cost nothing.
+static void snapshotBuild(void) {
+    E.snapshot = nodeNew(1);
+    for (int i = 0; i < E.numrows; i++) {
+        snapshotInsertLine(i, E.row[i].chars, E.row[i].size);
+    }
+}
+
+void snapshotInsertLine(int at, const char *s, size_t len) {
+    if (!E.snapshot) return;
+    if (at < 0 || at > E.snapshot->nlines) return;
+    E.snapshot = nodeUnique(E.snapshot);
+    struct snapNode *split = nodeInsert(E.snapshot, at, lineNew(s, len));
+    if (split) {
+        struct snapNode *root = nodeNew(0);
+        root->slots[0] = E.snapshot;
+        root->slots[1] = split;
+        root->count = 2;
+        nodeRecount(root);
+        E.snapshot = root;
+    }
+}
+
+void snapshotDelLine(int at) {
+    if (!E.snapshot) return;
+    if (at < 0 || at >= E.snapshot->nlines) return;
+    E.snapshot = nodeUnique(E.snapshot);
+    nodeDelete(E.snapshot, at);
+    // Collapse roots that have been hollowed out to a single child
+    while (!E.snapshot->leaf && E.snapshot->count <= 1) {
+        struct snapNode *old = E.snapshot;
+        if (old->count == 0) {
+            E.snapshot = nodeNew(1);
+        } else {
+            E.snapshot = old->slots[0];
+            nodeRetain(E.snapshot);
+        }
+        nodeRelease(old);
+    }
+}
+
+void snapshotSetLine(int at, const char *s, size_t len) {
+    if (!E.snapshot) return;
+    if (at < 0 || at >= E.snapshot->nlines) return;
+    E.snapshot = nodeUnique(E.snapshot);
+    nodeSet(E.snapshot, at, lineNew(s, len));
+}
+
+void snapshotReset(void) {
+    if (!E.snapshot) return;
+    nodeRelease(E.snapshot);
+    E.snapshot = NULL;
+}
+
+/*** snapshots ***/
+struct snapNode *editorSnapshot(void) {
+    if (!E.snapshot) snapshotBuild();
+    nodeRetain(E.snapshot);
+    __atomic_add_fetch(&snap_outstanding, 1, __ATOMIC_RELAXED);
+    return E.snapshot;
+}
+
+void snapshotRelease(struct snapNode *snap) {
+    if (!snap) return;
+    __atomic_sub_fetch(&snap_outstanding, 1, __ATOMIC_RELAXED);
+    nodeRelease(snap);
+}
+
+int snapshotNumLines(struct snapNode *snap) {
+    return snap->nlines;
+}
+
+long long snapshotSize(struct snapNode *snap) {
+    return snap->nbytes;
+}
+
+const char *snapshotLine(struct snapNode *snap, int at, int *len) {
+    if (at < 0 || at >= snap->nlines) return NULL;
+    struct snapNode *n = snap;
+    while (!n->leaf) {
+        n = n->slots[nodeChildFor(n, &at, 0)];
+    }
+    struct snapLine *l = n->slots[at];
+    if (len) *len = l->len;
+    return l->data;
+}
+
+/*** output ***/
+struct snapWriter {
+    int fd;
+    int len;
+    char buf[65536];
+};
+
+static int writerFlush(struct snapWriter *w) {
+    int off = 0;
+    while (off < w->len) {
+        ssize_t n = write(w->fd, &w->buf[off], w->len - off);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        off += n;
+    }
+    w->len = 0;
+    return 0;
+}
+
+static int writerAppend(struct snapWriter *w, const char *s, int len) {
+    if (w->len + len > (int)sizeof(w->buf)) {
+        if (writerFlush(w) == -1) return -1;
+        if (len > (int)sizeof(w->buf)) {
+            w->len = 0;
+            while (len > 0) {
+                ssize_t n = write(w->fd, s, len);
+                if (n == -1) {
+                    if (errno == EINTR) continue;
+                    return -1;
+                }
+                s += n;
+                len -= n;
+            }
+            return 0;
+        }
+    }
+    memcpy(&w->buf[w->len], s, len);
+    w->len += len;
+    return 0;
+}
+
+static int nodeWrite(struct snapNode *n, struct snapWriter *w) {
+    for (int i = 0; i < n->count; i++) {
+        if (n->leaf) {
+            struct snapLine *l = n->slots[i];
+            if (writerAppend(w, l->data, l->len) == -1) return -1;
+            if (writerAppend(w, "\n", 1) == -1) return -1;
+        } else if (nodeWrite(n->slots[i], w) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int snapshotWrite(struct snapNode *snap, int fd) {
+    struct snapWriter *w = malloc(sizeof(struct snapWriter));
+    w->fd = fd;
+    w->len = 0;
+    int code = nodeWrite(snap, w);
+    if (code == 0) code = writerFlush(w);
+    free(w);
+    return code;
+}
+
+/*** stats ***/
+static long long nodeLiveBytes(struct snapNode *n) {
+    long long bytes = sizeof(struct snapNode);
+    for (int i = 0; i < n->count; i++) {
+        if (n->leaf) {
+            bytes += sizeof(struct snapLine) + ((struct snapLine *)n->slots[i])->len;
+        } else {
+            bytes += nodeLiveBytes(n->slots[i]);
+        }
+    }
+    return bytes;
+}
+
+void snapshotGetStats(struct snapshotStats *st) {
+    st->snapshots = SNAP_LOAD(snap_outstanding);
+    st->nodes = SNAP_LOAD(snap_nodes);
+    st->lines = SNAP_LOAD(snap_lines);
+    st->node_bytes = SNAP_LOAD(snap_node_bytes);
+    st->line_bytes = SNAP_LOAD(snap_line_bytes);
+    // Whatever is not reachable from the live tree is kept alive by
+    // outstanding snapshots only: that is their memory overhead.
+    st->live_bytes = E.snapshot ? nodeLiveBytes(E.snapshot) : 0;
+}
@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stddef.h>
+
+/* Persistent, structurally shared copy of the buffer.
+ *
+ * Lines live in the leaves of a B-tree whose nodes are reference counted.
+ * Taking a snapshot only bumps the count on the root; the next edit copies
+ * the path from the root down to the changed leaf and leaves every other
+ * node shared. Nodes reachable from a snapshot are never written again, so
+ * a snapshot can be read from another thread while the UI keeps editing.
+ */
+#define SNAP_FANOUT 32
+
+struct snapLine {
+    int refs;
+    int len;
+    char data[];
+};
+
+struct snapNode {
+    int refs;
+    int leaf;
+    int count;
+    int nlines;
+    long long nbytes;
+    void *slots[SNAP_FANOUT];
+};
+
+struct snapshotStats {
+    int snapshots;
+    long nodes;
+    long lines;
+    long long node_bytes;
+    long long line_bytes;
+    long long live_bytes;
+};
+
+struct snapNode *editorSnapshot(void);
+
+void snapshotRelease(struct snapNode *snap);
+
+int snapshotNumLines(struct snapNode *snap);
+
+long long snapshotSize(struct snapNode *snap);
+
+const char *snapshotLine(struct snapNode *snap, int at, int *len);
+
+int snapshotWrite(struct snapNode *snap, int fd);
+
+void snapshotInsertLine(int at, const char *s, size_t len);
+
+void snapshotDelLine(int at);
+
+void snapshotSetLine(int at, const char *s, size_t len);
+
+void snapshotReset(void);
+
+void snapshotGetStats(struct snapshotStats *st);
+
+#endif
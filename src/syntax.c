@@ -12,7 +12,11 @@
 #include <unistd.h>
 
 #include "terminal.h"
+#include "bracket.h"
+#include "memory.h"
+#include "rowalloc.h"
 #include "syntax.h"
+#include "profile.h"
 #include "userinput.h"
 
 /*** filetypes ***/
@@ -37,18 +41,28 @@ struct editorSyntax HLDB[] = {
 
 /*** syntax highlighting ***/
 int is_separator(int c) {
-    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+    return isspace((unsigned char)c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
 }
 
-void editorUpdateSyntax(erow *row) {
-    row->hl = realloc(row->hl, row->rsize);
-    memset(row->hl, HL_NORMAL, row->rsize);
-    int i = 0;
+// Highlight render[start, end) starting from the given entry state and
+// return the state the next range has to start from. A whole row is one
+// range; rows in long-line mode are highlighted one segment at a time.
+static struct hlState editorHighlightRange(erow *row, int start, int end,
+        struct hlState st) {
+    int i = start + st.skip;
     unsigned char prev_hl = HL_NORMAL;
-    char prev_char = '\0';
+    char prev_char = st.prev_char;
+
+    int in_string = st.in_string;
+    int in_comment = st.in_comment;
 
-    int in_string = 0;
-    int in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
+    if (i < end) memset(&row->hl[i], HL_NORMAL, end - i);
+    if (st.in_sl_comment) {
+        if (i < end) memset(&row->hl[i], HL_COMMENT, end - i);
+        st.skip = i < end ? 0 : i - end;
+        st.prev_hl = HL_COMMENT;
+        return st;
+    }
 
     char *scs = E.syntax->singleline_comment_start;
     int scs_len = scs ? strlen(scs) : 0;
@@ -61,7 +75,7 @@ void editorUpdateSyntax(erow *row) {
 
     char **keywords = E.syntax->keywords;
 
-    while(i < row->rsize) {
+    while(i < end) {
         if (i != 0) {
             prev_hl = row->hl[i-1];
         }
@@ -70,7 +84,9 @@ void editorUpdateSyntax(erow *row) {
         /** singleline comments **/
         if (!strncmp(&row->render[i], scs, scs_len) && scs_len && !in_string 
                 && !in_comment) {
-            memset(&row->hl[i], HL_COMMENT, row->rsize - i);
+            memset(&row->hl[i], HL_COMMENT, end - i);
+            st.in_sl_comment = 1;
+            i = end;
             break;
         }
 
@@ -125,7 +141,7 @@ void editorUpdateSyntax(erow *row) {
 
         /** Digits **/
         if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-            if ((isdigit(c) && (is_separator(prev_char) || prev_hl == HL_NUMBER)) ||
+            if ((isdigit((unsigned char)c) && (is_separator(prev_char) || prev_hl == HL_NUMBER)) ||
                     (c == '.' && prev_hl == HL_NUMBER)) {
                 row->hl[i] = HL_NUMBER;
                 prev_char = c;
@@ -152,12 +168,135 @@ void editorUpdateSyntax(erow *row) {
         prev_char = c;
         i++;
     }  
+    // Tokens may run past the end of the range; the next range skips them
+    st.skip = i > end ? i - end : 0;
+    st.in_string = in_string;
+    st.in_comment = in_comment;
+    st.prev_char = prev_char;
+    st.prev_hl = i > 0 && i <= row->rsize ? row->hl[i-1] : HL_NORMAL;
+    return st;
+}
+
+static int hlStateEqual(struct hlState *a, struct hlState *b) {
+    return a->in_string == b->in_string && a->in_comment == b->in_comment &&
+        a->in_sl_comment == b->in_sl_comment && a->skip == b->skip &&
+        a->prev_char == b->prev_char && a->prev_hl == b->prev_hl;
+}
+
+static struct hlState editorRowEntryState(erow *row) {
+    struct hlState st;
+    memset(&st, 0, sizeof(st));
+    st.in_comment = (row->idx > 0 && E.row[row->idx - 1].hl_open_comment);
+    return st;
+}
+
+static void editorFinishSyntax(erow *row, int in_comment) {
     int changed = (row->hl_open_comment != in_comment);
     row->hl_open_comment = in_comment;
     if (changed && row->idx + 1 < E.numrows)
         editorUpdateSyntax(&E.row[row->idx + 1]);
 }
 
+// Rows loaded from a line cache already know their comment state, their
+// hl waits until they are drawn
+static int syntax_deferred = 0;
+
+void editorSyntaxDefer(int defer) {
+    syntax_deferred = defer;
+}
+
+// Highlight row without looking at the rows after it. Returns whether it
+// ends inside a block comment.
+static int editorHighlightRow(erow *row) {
+    row->hl = memRowRealloc(E.hl_arena, MEM_HL, row->hl, row->rsize);
+    if (E.syntax == NULL) {
+        memset(row->hl, HL_NORMAL, row->rsize);
+        bracketRowChanged(row);
+        return row->hl_open_comment;
+    }
+    struct hlState st = editorRowEntryState(row);
+    if (row->nsegs == 0) {
+        st = editorHighlightRange(row, 0, row->rsize, st);
+    } else {
+        for (int k = 0; k < row->nsegs; k++) {
+            struct rowSegment *seg = &row->segs[k];
+            seg->state = st;
+            st = editorHighlightRange(row, seg->start, seg->start + seg->len, st);
+        }
+    }
+    bracketRowChanged(row);
+    return st.in_comment;
+}
+
+void editorUpdateSyntax(erow *row) {
+    PROFILE_BEGIN(PROF_SYNTAX);
+    E.version++;
+    if (syntax_deferred) {
+        // A bracket index still needs the row's brackets, not its hl
+        if (E.brackets) {
+            editorHighlightRow(row);
+            editorRowDropHl(row);
+        }
+        PROFILE_END(PROF_SYNTAX);
+        return;
+    }
+    int in_comment = editorHighlightRow(row);
+    if (E.syntax != NULL) editorFinishSyntax(row, in_comment);
+    PROFILE_END(PROF_SYNTAX);
+}
+
+// Highlight rows first to last in one pass, the way loading them does
+void editorUpdateSyntaxRows(int first, int last) {
+    PROFILE_BEGIN(PROF_SYNTAX);
+    E.version++;
+    for (int i = first; i <= last && i < E.numrows; i++) {
+        E.row[i].hl_open_comment = editorHighlightRow(&E.row[i]);
+    }
+    PROFILE_END(PROF_SYNTAX);
+}
+
+// Rows can lose their hl to the memory budget; rebuild it before use.
+// The row's comment state survives, so nothing after it is touched.
+void editorRowEnsureHl(erow *row) {
+    if (row->hl == NULL) editorUpdateSyntax(row);
+}
+
+// Let go of hl that was only built to be looked at once
+void editorRowDropHl(erow *row) {
+    memRowFree(E.hl_arena, MEM_HL, row->hl);
+    row->hl = NULL;
+}
+
+// Re-highlight a long row from segment `from`, which must cover the edit
+// in segment `edited`. Past that, stop as soon as a segment is entered in
+// the same state as before the edit: nothing after it can have changed.
+void editorUpdateSyntaxSegments(erow *row, int from, int edited) {
+    PROFILE_BEGIN(PROF_SYNTAX);
+    E.version++;
+    if (E.syntax == NULL) {
+        for (int k = from; k <= edited && k < row->nsegs; k++) {
+            memset(&row->hl[row->segs[k].start], HL_NORMAL, row->segs[k].len);
+        }
+        bracketSegmentsChanged(row, from, edited + 1);
+        PROFILE_END(PROF_SYNTAX);
+        return;
+    }
+    struct hlState st = from == 0 ? editorRowEntryState(row) : row->segs[from].state;
+    for (int k = from; k < row->nsegs; k++) {
+        struct rowSegment *seg = &row->segs[k];
+        if (k > edited && hlStateEqual(&st, &seg->state)) {
+            bracketSegmentsChanged(row, from, k);
+            PROFILE_END(PROF_SYNTAX);
+            return;
+        }
+        seg->state = st;
+        st = editorHighlightRange(row, seg->start, seg->start + seg->len, st);
+    }
+    bracketSegmentsChanged(row, from, row->nsegs);
+    editorFinishSyntax(row, st.in_comment);
+    PROFILE_END(PROF_SYNTAX);
+}
+
 int editorSyntaxToColor(int hl) {
     switch(hl) {
         case HL_MLCOMMENT:
@@ -38,8 +38,18 @@ extern char *C_HL_KEYWORDS[];
 
 int is_separator(int c);
 
+void editorSyntaxDefer(int defer);
+
 void editorUpdateSyntax(erow *row);
 
+void editorUpdateSyntaxRows(int first, int last);
+
+void editorRowEnsureHl(erow *row);
+
+void editorRowDropHl(erow *row);
+
+void editorUpdateSyntaxSegments(erow *row, int from, int edited);
+
 int editorSyntaxToColor(int hl);
 
 void editorSelectSyntaxHilighting(void);
@@ -1,4 +1,5 @@
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
@@ -6,15 +7,13 @@
 #include <unistd.h>
 
 #include "terminal.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "userinput.h"
+#include "view.h"
 
 /*** terminal ***/
-void die(const char *s) {
-    write(STDOUT_FILENO, "\x1b[2J", 4);
-    write(STDOUT_FILENO, "\x1b[H", 3);
-    perror(s);
-    exit(1);
-}
-
 void disableRawMode(void) {
     /* Restore terminal flags */
     int code = tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios);
@@ -48,8 +47,9 @@ void enableRawMode(void) {
     raw.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
     raw.c_cflag &= ~(CSIZE | PARENB);
     raw.c_cflag |= CS8;
+    // Reads never block: the event loop only reads once input is ready
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VTIME] = 0;
 
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
 }
@@ -84,3 +84,36 @@ int getWindowSize(int *rows, int *cols) {
         return 0;
     }
 }
+
+/*** events ***/
+void editorTerminalInput(int fd, void *arg) {
+    (void)arg;
+    char buf[4096];
+    int n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        editorFeedInput(buf, n, fd);
+    }
+    if (n == -1 && errno != EAGAIN && errno != EINTR) die("read");
+}
+
+static int resize_pending = 0;
+
+static void editorApplyResize(void *arg) {
+    (void)arg;
+    int rows, cols;
+    resize_pending = 0;
+    if (getWindowSize(&rows, &cols) == -1) return;
+    if (rows == viewTermRows() && cols == viewTermCols()) return;
+    editorResize(rows, cols);
+}
+
+// A drag sends a storm of SIGWINCH. Apply at most one resize per
+// KILO_RESIZE_DELAY, always with the size the terminal has by then.
+void editorHandleResize(int signo) {
+    static int timer = -1;
+    (void)signo;
+    if (resize_pending) return;
+    if (timer == -1) timer = eventLoopAddTimer(editorApplyResize, NULL);
+    resize_pending = 1;
+    eventLoopArmTimer(timer, KILO_RESIZE_DELAY, 0);
+}
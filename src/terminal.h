@@ -2,14 +2,50 @@
 #define TERMINAL_H_
 
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+struct colmapEntry {
+    int cx;
+    int rx;
+    // Where it starts in render
+    int ri;
+    int len;
+    int width;
+};
+
+struct hlState {
+    int in_string;
+    int in_comment;
+    int in_sl_comment;
+    int skip;
+    char prev_char;
+    unsigned char prev_hl;
+};
+
+struct rowSegment {
+    int start;
+    int len;
+    struct hlState state;
+    // Bracket summary of the segment; bracket_low is 1 until it is made
+    int bracket_sum;
+    int bracket_low;
+};
+
 typedef struct erow {
     int idx;
     int size;
     int rsize; 
+    // Bytes the line end after it takes on disk: 2 for CRLF, 0 for a last
+    // line without one
+    int eol;
     char *chars;
     char *render;
+    int render_owned;
+    struct colmapEntry *colmap;
+    int colmap_len;
+    struct rowSegment *segs;
+    int nsegs;
     unsigned char *hl;
     int hl_open_comment;
     int indent;
@@ -51,14 +87,23 @@ struct editorConfig {
     int rx;
     int cursor_pos;
     erow *row;
+    int rowcap;
+    struct rowArena *arena;
+    struct rowArena *hl_arena;
     int dirty;
+    // Bumped whenever what the rows look like changes
+    unsigned long version;
     char *filename;
     char *copy_buffer;
     int copy_buffer_len;
-    char statusMessage[80];
+    char statusMessage[160];
     int prev_char;
     int rowoff;
     int coloff;
+    // Soft wrap: rows fold at the width of the view, and the top of the
+    // view is wrapoff lines into row rowoff
+    int wrap;
+    int wrapoff;
     int lineno_offset;
     int numrows;
     int screenrows;
@@ -69,6 +114,20 @@ struct editorConfig {
     int select_end_x;
     int select_end_y;
     struct editorSyntax *syntax;
+    struct snapNode *snapshot;
+    struct editorLoader *loader;
+    struct journal *journal;
+    struct editorFollow *follow;
+    struct editorWatch *watch;
+    struct savedLines *saved;
+    struct decorSet *decor;
+    struct wrapIndex *wraps;
+    struct treapNode *folds;
+    struct bracketIndex *brackets;
+    // Bytes of each row, for offsets in the file
+    struct fenwick *offsets;
+    // Bytes of the file on disk that made it into the buffer
+    long long file_bytes;
     struct termios orig_termios;
 };
 
@@ -86,4 +145,8 @@ int getCursorPosition(int *rows, int *cols);
 
 int getWindowSize(int *rows, int *cols);
 
+void editorTerminalInput(int fd, void *arg);
+
+void editorHandleResize(int signo);
+
 #endif
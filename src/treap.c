@@ -0,0 +1,99 @@
+#include <stddef.h>
+
+#include "memory.h"
+#include "treap.h"
+
+static unsigned int treapRandom(void) {
+    static unsigned int seed = 2463534242u;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// n comes from MEM_LAYOUT, where treapFree gives it back. This makes it a
+// tree of one.
+void treapInit(struct treapNode *n, int row) {
+    n->row = row;
+    n->shift = 0;
+    n->prio = treapRandom();
+    n->left = n->right = NULL;
+}
+
+void treapMove(struct treapNode *n, int shift) {
+    if (!n) return;
+    n->row += shift;
+    n->shift += shift;
+}
+
+// Pass a pending shift on, before anything looks at the children
+void treapPush(struct treapNode *n) {
+    if (!n->shift) return;
+    treapMove(n->left, n->shift);
+    treapMove(n->right, n->shift);
+    n->shift = 0;
+}
+
+// Nodes before row to *a, the others to *b
+void treapSplit(struct treapNode *n, int row, struct treapNode **a, struct treapNode **b,
+        treapPull pull) {
+    if (!n) {
+        *a = *b = NULL;
+        return;
+    }
+    treapPush(n);
+    if (n->row < row) {
+        treapSplit(n->right, row, &n->right, b, pull);
+        *a = n;
+    } else {
+        treapSplit(n->left, row, a, &n->left, pull);
+        *b = n;
+    }
+    pull(n);
+}
+
+// Every node in a comes before every node in b
+struct treapNode *treapMerge(struct treapNode *a, struct treapNode *b, treapPull pull) {
+    if (!a) return b;
+    if (!b) return a;
+    if (a->prio > b->prio) {
+        treapPush(a);
+        a->right = treapMerge(a->right, b, pull);
+        pull(a);
+        return a;
+    }
+    treapPush(b);
+    b->left = treapMerge(a, b->left, pull);
+    pull(b);
+    return b;
+}
+
+// The last node of n, brought up to date
+struct treapNode *treapLast(struct treapNode *n) {
+    while (n) {
+        treapPush(n);
+        if (!n->right) break;
+        n = n->right;
+    }
+    return n;
+}
+
+// n without its last node. Returns what is left.
+struct treapNode *treapDropLast(struct treapNode *n, treapPull pull) {
+    treapPush(n);
+    if (n->right) {
+        n->right = treapDropLast(n->right, pull);
+        pull(n);
+        return n;
+    }
+    struct treapNode *left = n->left;
+    memFree(MEM_LAYOUT, n);
+    return left;
+}
+
+void treapFree(struct treapNode *n) {
+    if (!n) return;
+    treapFree(n->left);
+    treapFree(n->right);
+    memFree(MEM_LAYOUT, n);
+}
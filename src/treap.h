@@ -0,0 +1,44 @@
+#ifndef TREAP_H_
+#define TREAP_H_
+
+/* Treaps keyed by row, for what is kept per row or per run of rows.
+ *
+ * Nodes are ordered by row and heap ordered by a random priority, so the
+ * tree stays O(log n) deep. Rows coming or going move every node after
+ * them, which is a split, a shift left on the root of the half after and a
+ * merge: the shift is passed on to the children only once a walk goes
+ * through the node. Walks down the tree have to treapPush each node first.
+ *
+ * A module embeds struct treapNode as the first member of its own node and
+ * keeps a summary of the subtree there, which its pull callback works out
+ * again from the node and its children after they change.
+ */
+struct treapNode {
+    int row;
+    // Rows yet to be added to everything below this node
+    int shift;
+    unsigned int prio;
+    struct treapNode *left;
+    struct treapNode *right;
+};
+
+typedef void (*treapPull)(struct treapNode *n);
+
+void treapInit(struct treapNode *n, int row);
+
+void treapMove(struct treapNode *n, int shift);
+
+void treapPush(struct treapNode *n);
+
+void treapSplit(struct treapNode *n, int row, struct treapNode **a, struct treapNode **b,
+        treapPull pull);
+
+struct treapNode *treapMerge(struct treapNode *a, struct treapNode *b, treapPull pull);
+
+struct treapNode *treapLast(struct treapNode *n);
+
+struct treapNode *treapDropLast(struct treapNode *n, treapPull pull);
+
+void treapFree(struct treapNode *n);
+
+#endif
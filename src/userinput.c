@@ -1,20 +1,121 @@
+#define _GNU_SOURCE
+
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "editor_ops.h"
 #include "terminal.h"
+#include "bracket.h"
+#include "buffer.h"
 #include "draw.h"
 #include "fileio.h"
 #include "copypaste.h"
+#include "decor.h"
+#include "command.h"
+#include "editor.h"
+#include "profile.h"
+#include "eventloop.h"
+#include "fold.h"
+#include "journal.h"
+#include "server.h"
+#include "utf8.h"
+#include "view.h"
+#include "wrap.h"
+
+/*** input queue ***/
+// Bytes read from the terminal wait here until a key is decoded from them
+static char *input_buf = NULL;
+static int input_len = 0;
+static int input_pos = 0;
+static int input_cap = 0;
+
+// Who sent the queued bytes, a run at a time: each run ends where the
+// next one starts
+struct inputRun {
+    int end;
+    int source;
+};
+static struct inputRun *input_runs = NULL;
+static int input_run = 0;
+static int input_nruns = 0;
+static int input_runs_cap = 0;
+// Who sent the last byte taken
+static int input_source = -1;
+
+// source says who sent s, for editorInputSource to tell the keys apart
+void editorFeedInput(const char *s, int len, int source) {
+    if (input_pos == input_len) input_pos = input_len = input_run = input_nruns = 0;
+    if (input_len + len > input_cap) {
+        if (input_pos > 0) {
+            memmove(input_buf, &input_buf[input_pos], input_len - input_pos);
+            input_len -= input_pos;
+            int keep = 0;
+            for (int i = input_run; i < input_nruns; i++) {
+                if (input_runs[i].end <= input_pos) continue;
+                input_runs[keep] = input_runs[i];
+                input_runs[keep++].end -= input_pos;
+            }
+            input_run = 0;
+            input_nruns = keep;
+            input_pos = 0;
+        }
+        while (input_len + len > input_cap) input_cap = input_cap ? input_cap * 2 : 256;
+        input_buf = realloc(input_buf, input_cap);
+    }
+    memcpy(&input_buf[input_len], s, len);
+    input_len += len;
+    if (input_nruns > input_run && input_runs[input_nruns - 1].source == source) {
+        input_runs[input_nruns - 1].end = input_len;
+        return;
+    }
+    if (input_nruns == input_runs_cap) {
+        input_runs_cap = input_runs_cap ? input_runs_cap * 2 : 8;
+        input_runs = realloc(input_runs, sizeof(struct inputRun) * input_runs_cap);
+    }
+    input_runs[input_nruns].end = input_len;
+    input_runs[input_nruns++].source = source;
+}
+
+// Who sent the key being handled
+int editorInputSource(void) {
+    return input_source;
+}
+
+int editorInputPending(void) {
+    return input_pos < input_len;
+}
+
+// Take one byte of input, running the event loop while there is none.
+// Gives up after timeout_ms, or never if it is -1.
+static int editorReadByte(char *c, int timeout_ms) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!editorInputPending()) {
+        int wait = -1;
+        if (timeout_ms >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+                (now.tv_nsec - start.tv_nsec) / 1000000;
+            if (elapsed >= timeout_ms) return 0;
+            wait = timeout_ms - elapsed;
+        } else {
+            // Idle between keys: let timers and workers show their results
+            eventLoopFlushRedraw();
+        }
+        eventLoopWait(wait);
+    }
+    while (input_runs[input_run].end <= input_pos) input_run++;
+    input_source = input_runs[input_run].source;
+    *c = input_buf[input_pos++];
+    return 1;
+}
 
 int editorReadKey(void) {
-    int code = 0;
     char c;
-    while (code != 1) {
-        code = read(STDIN_FILENO, &c, 1);
-        if (code == -1) die("read");
-    }
+    editorReadByte(&c, -1);
     // Tab
     if (c == '\t') {
         return TAB_KEY;
@@ -23,18 +124,18 @@ int editorReadKey(void) {
     // Escape Sequences
     if (c == '\x1b') {
         char seq[5];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+        if (!editorReadByte(&seq[0], KILO_ESCAPE_TIMEOUT)) return '\x1b';
+        if (!editorReadByte(&seq[1], KILO_ESCAPE_TIMEOUT)) return '\x1b';
         if(seq[0] == '[') {
             if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
+                if (!editorReadByte(&seq[2], KILO_ESCAPE_TIMEOUT)) return '\x1b';
                 editorSetStatusMessage("%d,%d,%d", seq[0], seq[1], seq[2]);
                 // Text Selection (SHIFT+ARROWS)
                 //   <esc>[1;2<ABCD>
                 if (seq[1] == '1' && seq[2] == ';') {
-                    if (read(STDIN_FILENO, &seq[3], 1) != 1) return '\x1b';
+                    if (!editorReadByte(&seq[3], KILO_ESCAPE_TIMEOUT)) return '\x1b';
                     if (seq[3] == '2') {
-                        if (read(STDIN_FILENO, &seq[4], 1) != 1) return '\x1b';
+                        if (!editorReadByte(&seq[4], KILO_ESCAPE_TIMEOUT)) return '\x1b';
                         switch(seq[4]) {
                             case 'A': return SELECT_UP;
                             case 'B': return SELECT_DOWN;
@@ -75,7 +176,8 @@ int editorReadKey(void) {
         // If all else fails return ESC
         return '\x1b';
     }
-    return c;
+    // Bytes of UTF-8 come through as they are, one key each
+    return (unsigned char)c;
 }
 
 char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
@@ -96,7 +198,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
             return NULL;
         } else if (c == BACKSPACE || c == CTRL_KEY('h') || c == DELETE_KEY) {
             if (buflen > 0) {
-                buflen--;
+                buflen = utf8Prev(buf, buflen, buflen);
                 buf[buflen] = '\0';
                 editorRefreshScreen();
             }
@@ -106,7 +208,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int)) {
                 if (callback) callback(buf, c);
                 return buf;
             }
-        } else if (!iscntrl(c) && c < 128) {
+        } else if (!iscntrl(c) && c < 256) {
             if (buflen >= bufsize) {
                 bufsize *= 2;
                 buf = realloc(buf, bufsize);
@@ -133,47 +235,30 @@ int editorIsSelecting(void) {
     }
 }
 
-int isInSelection(int x, int y) {
-    if (!editorIsSelecting()) return 0;
-
-    // Up
-    if (E.select_start_y > E.select_end_y) {
-        // top line
-        if (y == E.select_end_y && x > E.select_end_x) {
-            return 1;
-        // bottom line
-        } else if (y == E.select_start_y && x <= E.select_start_x) {
-            return 1;
-        // between
-        } else if (y < E.select_start_y && y > E.select_end_y) {
-            return 1;
-        }
-    // Down
-    } else if (E.select_start_y < E.select_end_y) {
-        // top line
-        if (y == E.select_start_y && x >= E.select_start_x) {
-            return 1;
-        // bottom line
-        } else if (y == E.select_end_y && x < E.select_end_x) {
-            return 1;
-        // between
-        } else if (y > E.select_start_y && y < E.select_end_y) {
-            return 1;
-        }
-    // Same Line
-    } else if (E.select_start_y == E.select_end_y) {
-        if (y == E.select_start_y) {
-            // before
-            if (x >= E.select_start_x && x < E.select_end_x) {
-                return 1;
-            // after
-            } else if (x <= E.select_start_x && x > E.select_end_x) {
-                return 1;
-            }
-        }
+// Show E.select_* as a decoration. A selection running backwards covers
+// the chars after its end up to and including its start, the way copy()
+// reads it.
+void editorUpdateSelection(void) {
+    decorClear(DECOR_SELECT);
+    if (!editorIsSelecting()) return;
+    int backwards = E.select_end_y < E.select_start_y ||
+        (E.select_end_y == E.select_start_y && E.select_end_x < E.select_start_x);
+    if (backwards) {
+        decorAdd(DECOR_SELECT, E.select_end_y, E.select_end_x + 1,
+                E.select_start_y, E.select_start_x + 1);
+    } else {
+        decorAdd(DECOR_SELECT, E.select_start_y, E.select_start_x,
+                E.select_end_y, E.select_end_x);
     }
+}
 
-    return 0;
+void editorQuit(void) {
+    // Let queued saves land, then drop the recovery files
+    bufferShutdown();
+    journalShutdown();
+    editorWrite("\x1b[2J", 4);
+    editorWrite("\x1b[H", 3);
+    exit(0);
 }
 
 void editorProcessKeypress(void) {
@@ -183,15 +268,19 @@ void editorProcessKeypress(void) {
     switch(c) {
         // Quit on CTRL-q
         case CTRL_KEY('q'):
-            if (E.dirty && quit_confirm == 1) {
-                editorSetStatusMessage("File has unsaved changes. "
-                        "Press CTRL-Q again to quit, or press CTRL-S to save.");
+            // The daemon keeps every buffer for the next client
+            if (serverActive()) {
+                serverDetach();
+                break;
+            }
+            if (bufferAnyDirty() && quit_confirm == 1) {
+                editorSetStatusMessage("%s has unsaved changes. "
+                        "Press CTRL-Q again to quit, or press CTRL-S to save.",
+                        E.dirty ? "File" : "Another buffer");
                 quit_confirm--;
                 return;
             }
-            write(STDOUT_FILENO, "\x1b[2J", 4);
-            write(STDOUT_FILENO, "\x1b[H", 3);
-            exit(0);
+            editorQuit();
             break;
             // Navigation mapping
         case CTRL_KEY('c'):
@@ -203,6 +292,18 @@ void editorProcessKeypress(void) {
         case CTRL_KEY('f'):
             editorFind();
             break;
+        case CTRL_KEY('p'):
+            profileToggleOverlay();
+            break;
+        case CTRL_KEY('e'):
+            editorCommandPrompt();
+            break;
+        case CTRL_KEY('w'):
+            viewNext();
+            break;
+        case CTRL_KEY(']'):
+            bracketJump();
+            break;
         case '\r':
             editorInsertNewLine();
             break;
@@ -247,6 +348,10 @@ void editorProcessKeypress(void) {
             break;
         case PAGE_UP:
             {
+                if (E.wrap) {
+                    wrapPage(-1);
+                    break;
+                }
                 // Move cursor to top
                 E.cy = E.rowoff;
                 // Move up by a screen
@@ -254,13 +359,17 @@ void editorProcessKeypress(void) {
                 for (; times > 0; times--) editorMoveCursor(ARROW_UP);
                 editorScroll();
                 // Move cursor to bottom
-                E.cy = E.rowoff + E.screenrows - 1;
+                E.cy = foldRowAt(foldLineOf(E.rowoff) + E.screenrows - 1);
                 break;
             }
         case PAGE_DOWN:
             {
+                if (E.wrap) {
+                    wrapPage(1);
+                    break;
+                }
                 // Move cursor to bottom
-                E.cy = E.rowoff + E.screenrows - 1;
+                E.cy = foldRowAt(foldLineOf(E.rowoff) + E.screenrows - 1);
                 // Move up by a screen
                 int times = E.screenrows - 2;
                 for (; times > 0; times--) editorMoveCursor(ARROW_DOWN);
@@ -313,6 +422,7 @@ void editorProcessKeypress(void) {
             if (c == SELECT_LEFT) editorMoveCursor(ARROW_LEFT);
             E.select_end_x = E.cx;
             E.select_end_y = E.cy;
+            editorUpdateSelection();
             break;
         case CTRL_KEY('s'):
             editorSave();
@@ -321,6 +431,7 @@ void editorProcessKeypress(void) {
         case '\x1b':
             E.select_start_x = E.select_end_x;
             E.select_start_y = E.select_end_y;
+            editorUpdateSelection();
             //editorSetStatusMessage("ESC char");
             break;
         default:
@@ -1,16 +1,24 @@
 #ifndef USERINPUT_H_
 #define USERINPUT_H_
 
+void editorFeedInput(const char *s, int len, int source);
+
+int editorInputSource(void);
+
+int editorInputPending(void);
+
 int editorReadKey(void);
 
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
 
+void editorQuit(void);
+
 void editorProcessKeypress(void);
 
 void editorStartSelecting(void);
 
 int editorIsSelecting(void);
 
-int isInSelection(int x, int y);
+void editorUpdateSelection(void);
 
 #endif
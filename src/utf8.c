@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "utf8.h"
+
+struct utf8Range {
+    int first;
+    int last;
+};
+
+// Combining marks and other characters drawn over the one before them
+static const struct utf8Range zero_width[] = {
+    {0x0300, 0x036f}, {0x0483, 0x0489}, {0x0591, 0x05bd}, {0x05bf, 0x05bf},
+    {0x05c1, 0x05c2}, {0x05c4, 0x05c5}, {0x05c7, 0x05c7}, {0x0610, 0x061a},
+    {0x064b, 0x065f}, {0x0670, 0x0670}, {0x06d6, 0x06dc}, {0x06df, 0x06e4},
+    {0x06e7, 0x06e8}, {0x06ea, 0x06ed}, {0x0711, 0x0711}, {0x0730, 0x074a},
+    {0x0900, 0x0902}, {0x093a, 0x093a}, {0x093c, 0x093c}, {0x0941, 0x0948},
+    {0x094d, 0x094d}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0e31, 0x0e31},
+    {0x0e34, 0x0e3a}, {0x0e47, 0x0e4e}, {0x0eb1, 0x0eb1}, {0x0eb4, 0x0ebc},
+    {0x0ec8, 0x0ecd}, {0x1160, 0x11ff}, {0x1ab0, 0x1aff}, {0x1dc0, 0x1dff},
+    {0x200b, 0x200f}, {0x202a, 0x202e}, {0x2060, 0x2064}, {0x20d0, 0x20ff},
+    {0x302a, 0x302d}, {0x3099, 0x309a}, {0xfe00, 0xfe0f}, {0xfe20, 0xfe2f},
+    {0xfeff, 0xfeff}, {0x1f3fb, 0x1f3ff}, {0xe0001, 0xe0001}, {0xe0020, 0xe007f},
+    {0xe0100, 0xe01ef},
+};
+
+// East Asian wide and fullwidth characters, and emoji shown as such
+static const struct utf8Range wide[] = {
+    {0x1100, 0x115f}, {0x231a, 0x231b}, {0x2329, 0x232a}, {0x23e9, 0x23ec},
+    {0x23f0, 0x23f0}, {0x23f3, 0x23f3}, {0x25fd, 0x25fe}, {0x2614, 0x2615},
+    {0x2648, 0x2653}, {0x267f, 0x267f}, {0x2693, 0x2693}, {0x26a1, 0x26a1},
+    {0x26aa, 0x26ab}, {0x26bd, 0x26be}, {0x26c4, 0x26c5}, {0x26ce, 0x26ce},
+    {0x26d4, 0x26d4}, {0x26ea, 0x26ea}, {0x26f2, 0x26f3}, {0x26f5, 0x26f5},
+    {0x26fa, 0x26fa}, {0x26fd, 0x26fd}, {0x2705, 0x2705}, {0x270a, 0x270b},
+    {0x2728, 0x2728}, {0x274c, 0x274c}, {0x274e, 0x274e}, {0x2753, 0x2755},
+    {0x2757, 0x2757}, {0x2795, 0x2797}, {0x27b0, 0x27b0}, {0x27bf, 0x27bf},
+    {0x2b1b, 0x2b1c}, {0x2b50, 0x2b50}, {0x2b55, 0x2b55}, {0x2e80, 0x3029},
+    {0x302e, 0x303e}, {0x3041, 0x3098}, {0x309b, 0x33ff}, {0x3400, 0x4dbf},
+    {0x4e00, 0x9fff}, {0xa000, 0xa4cf}, {0xa960, 0xa97f}, {0xac00, 0xd7a3},
+    {0xf900, 0xfaff}, {0xfe10, 0xfe19}, {0xfe30, 0xfe6f}, {0xff00, 0xff60},
+    {0xffe0, 0xffe6}, {0x16fe0, 0x16fe4}, {0x17000, 0x18cff}, {0x1b000, 0x1b2ff},
+    {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a},
+    {0x1f200, 0x1f251}, {0x1f300, 0x1f320}, {0x1f32d, 0x1f335}, {0x1f337, 0x1f37c},
+    {0x1f37e, 0x1f393}, {0x1f3a0, 0x1f3ca}, {0x1f3cf, 0x1f3d3}, {0x1f3e0, 0x1f3f0},
+    {0x1f3f4, 0x1f3f4}, {0x1f3f8, 0x1f3fa}, {0x1f400, 0x1f43e}, {0x1f440, 0x1f440},
+    {0x1f442, 0x1f4fc}, {0x1f4ff, 0x1f53d}, {0x1f54b, 0x1f54e}, {0x1f550, 0x1f567},
+    {0x1f57a, 0x1f57a}, {0x1f595, 0x1f596}, {0x1f5a4, 0x1f5a4}, {0x1f5fb, 0x1f64f},
+    {0x1f680, 0x1f6c5}, {0x1f6cc, 0x1f6cc}, {0x1f6d0, 0x1f6d2}, {0x1f6d5, 0x1f6d7},
+    {0x1f6eb, 0x1f6ec}, {0x1f6f4, 0x1f6fc}, {0x1f7e0, 0x1f7eb}, {0x1f90c, 0x1f93a},
+    {0x1f93c, 0x1f945}, {0x1f947, 0x1f9ff}, {0x1fa70, 0x1faff}, {0x20000, 0x2fffd},
+    {0x30000, 0x3fffd},
+};
+
+static int utf8InTable(const struct utf8Range *table, int n, int cp) {
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (table[mid].last < cp) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && table[lo].first <= cp;
+}
+
+/*** decoding ***/
+// Length of the run of printable ASCII s starts with. A word at a time:
+// a byte is out if its high bit is set, if it is below ' ' or if it is DEL.
+int utf8Plain(const char *s, int len) {
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    int i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t x, del;
+        memcpy(&x, &s[i], 8);
+        del = x ^ (ones * 0x7f);
+        if ((x | ((x - ones * ' ') & ~x) | ((del - ones) & ~del)) & highs) break;
+    }
+    while (i < len && (unsigned char)s[i] >= ' ' && (unsigned char)s[i] < 0x7f) i++;
+    return i;
+}
+
+// Bytes in the character at s, with its code point in *cp. A byte that
+// starts no valid sequence is a character of its own, with *cp = -1; so
+// are C1 controls, which terminals would act on.
+int utf8Decode(const char *s, int len, int *cp) {
+    const unsigned char *u = (const unsigned char *)s;
+    int n, c, min;
+    *cp = -1;
+    if (len <= 0) return 0;
+    if (u[0] < 0x80) {
+        *cp = u[0];
+        return 1;
+    } else if (u[0] >= 0xc2 && u[0] <= 0xdf) {
+        n = 2, c = u[0] & 0x1f, min = 0xa0;
+    } else if (u[0] >= 0xe0 && u[0] <= 0xef) {
+        n = 3, c = u[0] & 0x0f, min = 0x800;
+    } else if (u[0] >= 0xf0 && u[0] <= 0xf4) {
+        n = 4, c = u[0] & 0x07, min = 0x10000;
+    } else {
+        return 1;
+    }
+    if (len < n) return 1;
+    for (int i = 1; i < n; i++) {
+        if ((u[i] & 0xc0) != 0x80) return 1;
+        c = (c << 6) | (u[i] & 0x3f);
+    }
+    // Overlong forms, surrogates and what lies past Unicode
+    if (c < min || (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff) return 1;
+    *cp = c;
+    return n;
+}
+
+// Columns the character takes on screen
+int utf8Width(int cp) {
+    if (cp < 0x300) return 1;
+    if (utf8InTable(zero_width, sizeof(zero_width) / sizeof(zero_width[0]), cp)) return 0;
+    if (cp >= 0x1100 && utf8InTable(wide, sizeof(wide) / sizeof(wide[0]), cp)) return 2;
+    return 1;
+}
+
+/*** moving ***/
+// Where the character ending just before `at` starts
+static int utf8Back(const char *s, int len, int at) {
+    int i = at - 1, cp;
+    while (i > 0 && at - i < 4 && ((unsigned char)s[i] & 0xc0) == 0x80) i--;
+    if (utf8Decode(&s[i], len - i, &cp) == at - i) return i;
+    return at - 1;
+}
+
+// The next place a cursor can be after `at`, past any marks combining
+// with the character there
+int utf8Next(const char *s, int len, int at) {
+    int cp;
+    if (at >= len) return len;
+    at += utf8Decode(&s[at], len - at, &cp);
+    while (at < len) {
+        int n = utf8Decode(&s[at], len - at, &cp);
+        if (n < 2 || utf8Width(cp) != 0) break;
+        at += n;
+    }
+    return at;
+}
+
+// The place a cursor can be before `at`
+int utf8Prev(const char *s, int len, int at) {
+    int cp;
+    if (at <= 0) return 0;
+    int i = utf8Back(s, len, at);
+    while (i > 0 && utf8Decode(&s[i], len - i, &cp) > 1 && utf8Width(cp) == 0) {
+        i = utf8Back(s, len, i);
+    }
+    return i;
+}
@@ -0,0 +1,26 @@
+#ifndef UTF8_H_
+#define UTF8_H_
+
+/* UTF-8 text.
+ *
+ * Rows keep their bytes as they are in the file. Where the screen needs
+ * characters, sequences are decoded here: how many bytes make up one and
+ * how many columns it takes, two for East Asian wide and fullwidth
+ * characters, none for combining marks. Bytes that don't form a valid
+ * sequence are one column each and show as '?'.
+ *
+ * Most rows are plain ASCII, so utf8Plain finds the printable ASCII run at
+ * the start of a string eight bytes at a time, and callers only decode what
+ * comes after it.
+ */
+int utf8Plain(const char *s, int len);
+
+int utf8Decode(const char *s, int len, int *cp);
+
+int utf8Width(int cp);
+
+int utf8Next(const char *s, int len, int at);
+
+int utf8Prev(const char *s, int len, int at);
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "terminal.h"
+#include "bracket.h"
+#include "buffer.h"
+#include "draw.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "view.h"
+
+struct editorView {
+    // bufferId of what it shows
+    int buffer;
+    // Live in E while the view is current
+    int cx;
+    int cy;
+    int rx;
+    int rowoff;
+    int coloff;
+    int wrap;
+    int wrapoff;
+    int cursor_pos;
+    // The bracket at its cursor and the match
+    struct bracketPair brackets;
+    // On screen: rows of text from top, then the status line
+    int top;
+    int left;
+    int rows;
+    int cols;
+    // What each line drew last time, status line last, and how wide it was
+    struct abuf *lines;
+    int *widths;
+    int nlines;
+    // What the text lines were drawn from
+    int drawn;
+    int drawn_buffer;
+    unsigned long drawn_version;
+    int drawn_rowoff;
+    int drawn_coloff;
+    int drawn_wrap;
+    int drawn_wrapoff;
+    int drawn_lineno;
+    int drawn_loading;
+};
+
+// A view, or a split into a (top or left) and b (bottom or right)
+struct viewNode {
+    struct editorView *view;
+    int vertical;
+    struct viewNode *a;
+    struct viewNode *b;
+    struct viewNode *parent;
+};
+
+static struct viewNode *root = NULL;
+static struct viewNode *current = NULL;
+static int term_rows = 24;
+static int term_cols = 80;
+
+/*** views ***/
+// The cursor and viewport of the current view are in E
+static void viewSave(struct editorView *v) {
+    v->buffer = bufferId();
+    v->cx = E.cx;
+    v->cy = E.cy;
+    v->rx = E.rx;
+    v->rowoff = E.rowoff;
+    v->coloff = E.coloff;
+    v->wrap = E.wrap;
+    v->wrapoff = E.wrapoff;
+    v->cursor_pos = E.cursor_pos;
+}
+
+static void viewLoad(struct editorView *v) {
+    E.cx = v->cx;
+    E.cy = v->cy;
+    E.rx = v->rx;
+    E.rowoff = v->rowoff;
+    E.coloff = v->coloff;
+    E.wrap = v->wrap;
+    E.wrapoff = v->wrapoff;
+    E.cursor_pos = v->cursor_pos;
+    E.screenrows = v->rows;
+    E.screencols = v->cols;
+    // Other views may have deleted rows under it
+    if (E.cy > E.numrows) E.cy = E.numrows;
+    if (E.cy < E.numrows && E.cx > E.row[E.cy].size) E.cx = E.row[E.cy].size;
+    if (E.cy == E.numrows) E.cx = 0;
+}
+
+static struct editorView *viewNew(void) {
+    struct editorView *v = calloc(1, sizeof(struct editorView));
+    viewSave(v);
+    return v;
+}
+
+static void viewFree(struct editorView *v) {
+    for (int i = 0; i < v->nlines; i++) abFree(&v->lines[i]);
+    free(v->lines);
+    free(v->widths);
+    free(v);
+}
+
+/*** layout ***/
+static void viewPlace(struct editorView *v, int top, int left, int lines, int cols) {
+    for (int i = 0; i < v->nlines; i++) abFree(&v->lines[i]);
+    v->top = top;
+    v->left = left;
+    v->rows = lines > 1 ? lines - 1 : 1;
+    v->cols = cols > 1 ? cols : 1;
+    v->nlines = v->rows + 1;
+    v->lines = realloc(v->lines, sizeof(struct abuf) * v->nlines);
+    v->widths = realloc(v->widths, sizeof(int) * v->nlines);
+    for (int i = 0; i < v->nlines; i++) {
+        v->lines[i] = (struct abuf)ABUF_INIT;
+        v->widths[i] = 0;
+    }
+    v->drawn = 0;
+}
+
+// Share out lines x cols at (top, left): vertical splits give a column to
+// the separator, every view keeps a line for its status
+static void viewLayout(struct viewNode *n, int top, int left, int lines, int cols) {
+    if (n->view) {
+        viewPlace(n->view, top, left, lines, cols);
+    } else if (n->vertical) {
+        int a = (cols - 1) / 2;
+        viewLayout(n->a, top, left, lines, a);
+        viewLayout(n->b, top, left + a + 1, lines, cols - a - 1);
+    } else {
+        int a = lines / 2;
+        viewLayout(n->a, top, left, a, cols);
+        viewLayout(n->b, top + a, left, lines - a, cols);
+    }
+}
+
+static void viewRelayout(void) {
+    viewLayout(root, 0, 0, term_rows - 1, term_cols);
+    E.screenrows = current->view->rows;
+    E.screencols = current->view->cols;
+}
+
+// The screen starts out as a single view of the current buffer
+static void viewSetup(void) {
+    if (root) return;
+    root = calloc(1, sizeof(struct viewNode));
+    root->view = viewNew();
+    current = root;
+    viewRelayout();
+}
+
+void viewResize(int rows, int cols) {
+    term_rows = rows > 3 ? rows : 3;
+    term_cols = cols > 1 ? cols : 1;
+    viewSetup();
+    viewRelayout();
+}
+
+int viewTermRows(void) {
+    return term_rows;
+}
+
+int viewTermCols(void) {
+    return term_cols;
+}
+
+static int viewCountNode(struct viewNode *n) {
+    return n->view ? 1 : viewCountNode(n->a) + viewCountNode(n->b);
+}
+
+int viewCount(void) {
+    return root ? viewCountNode(root) : 1;
+}
+
+static int viewShowsNode(struct viewNode *n, int id) {
+    if (n->view) return n != current && n->view->buffer == id;
+    return viewShowsNode(n->a, id) || viewShowsNode(n->b, id);
+}
+
+// Whether a view other than the current one, which shows E, shows buffer id
+int viewShowsBuffer(int id) {
+    return root ? viewShowsNode(root, id) : 0;
+}
+
+// Make n current, showing its own buffer again
+static void viewActivate(struct viewNode *n) {
+    struct editorView *v = n->view;
+    current = n;
+    int at = bufferFindId(v->buffer);
+    if (at == -1) v->buffer = bufferId();
+    else bufferSwitch(at);
+    viewLoad(v);
+    eventLoopRequestRedraw();
+}
+
+// Split the current view in two, side by side if vertical. The cursor
+// stays in the top or left half.
+int viewSplit(int vertical) {
+    viewSetup();
+    struct editorView *v = current->view;
+    if (vertical ? v->cols < 2 * KILO_VIEW_MIN_COLS + 1 :
+            v->rows + 1 < 2 * (KILO_VIEW_MIN_ROWS + 1)) return -1;
+    viewSave(v);
+    struct viewNode *a = calloc(1, sizeof(struct viewNode));
+    struct viewNode *b = calloc(1, sizeof(struct viewNode));
+    a->view = v;
+    b->view = viewNew();
+    a->parent = b->parent = current;
+    current->view = NULL;
+    current->vertical = vertical;
+    current->a = a;
+    current->b = b;
+    current = a;
+    viewRelayout();
+    eventLoopRequestRedraw();
+    return 0;
+}
+
+// Close the current view and give its space to its sibling. -1 for the
+// last view.
+int viewClose(void) {
+    if (!root || current == root) return -1;
+    struct viewNode *gone = current;
+    struct viewNode *parent = gone->parent;
+    struct viewNode *sibling = parent->a == gone ? parent->b : parent->a;
+    sibling->parent = parent->parent;
+    if (!parent->parent) root = sibling;
+    else if (parent->parent->a == parent) parent->parent->a = sibling;
+    else parent->parent->b = sibling;
+    viewFree(gone->view);
+    free(gone);
+    free(parent);
+
+    struct viewNode *n = sibling;
+    while (!n->view) n = n->a;
+    current = n;
+    viewRelayout();
+    viewActivate(n);
+    return 0;
+}
+
+// Move to the next view, top to bottom and left to right
+void viewNext(void) {
+    if (!root || current == root) return;
+    viewSave(current->view);
+    struct viewNode *n = current;
+    while (n->parent && n->parent->b == n) n = n->parent;
+    n = n->parent ? n->parent->b : root;
+    while (!n->view) n = n->a;
+    viewActivate(n);
+}
+
+/*** drawing ***/
+static void viewRenderView(struct editorView *v, int is_current) {
+    struct editorView shown;
+    int prev = -1, swapped = 0;
+    if (!is_current) {
+        viewSave(&shown);
+        shown.rows = E.screenrows;
+        shown.cols = E.screencols;
+        prev = bufferEnterId(v->buffer);
+        swapped = prev != -1 && prev != bufferCurrent();
+        // Its buffer was closed, it shows the current one instead
+        if (prev == -1) v->buffer = bufferId();
+        viewLoad(v);
+        editorScroll();
+    }
+
+    int loading = E.loader != NULL;
+    int moved = bracketHighlight(&v->brackets);
+    if (!v->drawn || moved || v->drawn_buffer != v->buffer || v->drawn_version != E.version ||
+            v->drawn_rowoff != E.rowoff || v->drawn_coloff != E.coloff ||
+            v->drawn_wrap != E.wrap || v->drawn_wrapoff != E.wrapoff ||
+            v->drawn_lineno != E.lineno_offset || v->drawn_loading != loading) {
+        for (int y = 0; y < v->rows; y++) {
+            v->lines[y].len = 0;
+            v->widths[y] = editorDrawRowText(&v->lines[y], y);
+        }
+        v->drawn = 1;
+        v->drawn_buffer = v->buffer;
+        v->drawn_version = E.version;
+        v->drawn_rowoff = E.rowoff;
+        v->drawn_coloff = E.coloff;
+        v->drawn_wrap = E.wrap;
+        v->drawn_wrapoff = E.wrapoff;
+        v->drawn_lineno = E.lineno_offset;
+        v->drawn_loading = loading;
+    }
+    // The status line follows the cursor, so it is drawn every time
+    v->lines[v->rows].len = 0;
+    editorDrawStatusBar(&v->lines[v->rows]);
+    v->widths[v->rows] = v->cols;
+
+    if (!is_current) {
+        viewSave(v);
+        // A swapped in buffer gets its own state back from bufferLeave
+        if (swapped) {
+            E.screenrows = shown.rows;
+            E.screencols = shown.cols;
+        } else {
+            viewLoad(&shown);
+        }
+        bufferLeave(prev);
+    }
+}
+
+static void viewRenderNode(struct viewNode *n) {
+    if (n->view) {
+        viewRenderView(n->view, n == current);
+    } else {
+        viewRenderNode(n->a);
+        viewRenderNode(n->b);
+    }
+}
+
+// Bring every view's lines up to date for the next frame
+void viewRender(void) {
+    viewSetup();
+    viewSave(current->view);
+    viewRenderNode(root);
+}
+
+static void viewDrawNode(struct abuf *ab, struct viewNode *n, int y) {
+    if (!n->view) {
+        viewDrawNode(ab, n->a, y);
+        viewDrawNode(ab, n->b, y);
+        return;
+    }
+    struct editorView *v = n->view;
+    if (y < v->top || y > v->top + v->rows) return;
+    int line = y - v->top;
+    abAppend(ab, v->lines[line].b, v->lines[line].len);
+    if (v->left + v->cols >= term_cols) {
+        if (line < v->rows) abAppend(ab, "\x1b[K", 4);
+        return;
+    }
+    for (int x = v->widths[line]; x < v->cols; x++) abAppend(ab, " ", 1);
+    abAppend(ab, "|", 1);
+}
+
+// Screen line y, put together from the views it crosses
+void viewDrawLine(struct abuf *ab, int y) {
+    viewDrawNode(ab, root, y);
+}
+
+void viewCursor(int *y, int *x) {
+    struct editorView *v = current->view;
+    editorCursorPosition(y, x);
+    *y += v->top;
+    *x += v->left;
+}
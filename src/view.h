@@ -0,0 +1,40 @@
+#ifndef VIEW_H_
+#define VIEW_H_
+
+#include "draw.h"
+
+/* Split views.
+ *
+ * Everything above the message bar is tiled by views: rectangles of text
+ * rows with a status line under them, cut in two along either axis by a
+ * split. The halves of a split show the same buffer to begin with and can
+ * move or switch buffers on their own. Views of one buffer share its rows
+ * and highlighting; each keeps only a cursor, the bracket match at it, a
+ * viewport and the lines it drew last time, which are drawn again only
+ * once the buffer changed (E.version), the viewport or the match moved.
+ * The current view's cursor and viewport are the ones in E, and
+ * E.screenrows/E.screencols are its size.
+ */
+int viewSplit(int vertical);
+
+int viewClose(void);
+
+void viewNext(void);
+
+int viewCount(void);
+
+int viewShowsBuffer(int id);
+
+void viewResize(int rows, int cols);
+
+int viewTermRows(void);
+
+int viewTermCols(void);
+
+void viewRender(void);
+
+void viewDrawLine(struct abuf *ab, int y);
+
+void viewCursor(int *y, int *x);
+
+#endif
@@ -0,0 +1,193 @@
+#include <stdlib.h>
+
+#include "terminal.h"
+#include "editor_ops.h"
+#include "eventloop.h"
+#include "fenwick.h"
+#include "fold.h"
+#include "memory.h"
+#include "wrap.h"
+
+// Screen lines of every row at one width, in a tree
+struct wrapTree {
+    // 0 for a free slot
+    int width;
+    unsigned long used;
+    struct fenwick lines;
+};
+
+struct wrapIndex {
+    struct wrapTree trees[KILO_WRAP_WIDTHS];
+    unsigned long clock;
+};
+
+/*** breaks ***/
+// Where the line of row starting at column start ends and the next one
+// starts: width columns on, or at a wide character that would not fit,
+// which goes to the next line whole
+static int wrapNext(erow *row, int start, int width) {
+    int at;
+    editorRxToRender(row, start + width, &at);
+    return at > start ? at : start + width;
+}
+
+// Which of row's lines column col is on, and in *start where that starts.
+// Rows of ASCII break every width columns.
+static int wrapLineAt(erow *row, int col, int width, int *start) {
+    if (!editorRowWide(row)) {
+        *start = col - col % width;
+        return col / width;
+    }
+    int sub = 0, s = 0, next;
+    while ((next = wrapNext(row, s, width)) <= col) {
+        s = next;
+        sub++;
+    }
+    *start = s;
+    return sub;
+}
+
+/*** counts ***/
+// None for rows hidden in a fold
+static int wrapRowLines(erow *row, int width) {
+    if (foldHidden(row->idx)) return 0;
+    int start;
+    return 1 + wrapLineAt(row, editorRowWidth(row), width, &start);
+}
+
+// The tree for width, counted on first use
+static struct wrapTree *wrapTreeFor(int width) {
+    if (!E.wraps) E.wraps = calloc(1, sizeof(struct wrapIndex));
+    struct wrapTree *t = NULL, *oldest = &E.wraps->trees[0];
+    for (int k = 0; k < KILO_WRAP_WIDTHS; k++) {
+        struct wrapTree *c = &E.wraps->trees[k];
+        if (c->width == width) t = c;
+        if (c->used < oldest->used) oldest = c;
+    }
+    if (!t) {
+        t = oldest;
+        fenwickFree(&t->lines);
+        t->width = width;
+        for (int i = 0; i < E.numrows; i++) {
+            fenwickInsert(&t->lines, i, wrapRowLines(&E.row[i], width));
+        }
+    }
+    t->used = ++E.wraps->clock;
+    return t;
+}
+
+/*** edits ***/
+void wrapRowChanged(erow *row) {
+    if (!E.wraps) return;
+    for (int k = 0; k < KILO_WRAP_WIDTHS; k++) {
+        struct wrapTree *t = &E.wraps->trees[k];
+        if (!t->width || row->idx >= t->lines.n) continue;
+        int lines = wrapRowLines(row, t->width);
+        if (lines != fenwickGet(&t->lines, row->idx)) fenwickSet(&t->lines, row->idx, lines);
+    }
+}
+
+// E.row[at] is new. Only the tree from there on needs redoing, which for
+// the appends of a load is next to nothing.
+void wrapInsertRow(int at) {
+    if (!E.wraps) return;
+    for (int k = 0; k < KILO_WRAP_WIDTHS; k++) {
+        struct wrapTree *t = &E.wraps->trees[k];
+        if (!t->width || at > t->lines.n) continue;
+        fenwickInsert(&t->lines, at, wrapRowLines(&E.row[at], t->width));
+    }
+}
+
+void wrapDelRow(int at) {
+    if (!E.wraps) return;
+    for (int k = 0; k < KILO_WRAP_WIDTHS; k++) {
+        struct wrapTree *t = &E.wraps->trees[k];
+        if (!t->width || at >= t->lines.n) continue;
+        fenwickDelete(&t->lines, at);
+    }
+}
+
+void wrapFree(void) {
+    if (!E.wraps) return;
+    for (int k = 0; k < KILO_WRAP_WIDTHS; k++) fenwickFree(&E.wraps->trees[k].lines);
+    free(E.wraps);
+    E.wraps = NULL;
+}
+
+/*** lines ***/
+// Columns of text in the view, right of the line numbers
+int wrapWidth(void) {
+    int width = E.screencols - E.lineno_offset;
+    return width > 0 ? width : 1;
+}
+
+// The first screen line of row, counting from the top of the file. Rows
+// past the end take one line each.
+long long wrapLineOf(int row) {
+    struct wrapTree *t = wrapTreeFor(wrapWidth());
+    int n = t->lines.n;
+    if (row <= n) return fenwickPrefix(&t->lines, row);
+    return fenwickPrefix(&t->lines, n) + row - n;
+}
+
+// The row on screen line `line`, and in *sub which of its lines that is
+int wrapRowAt(long long line, int *sub) {
+    struct wrapTree *t = wrapTreeFor(wrapWidth());
+    if (line < 0) line = 0;
+    int row = fenwickFind(&t->lines, line);
+    long long first = fenwickPrefix(&t->lines, row);
+    if (row == t->lines.n) {
+        row += line - first;
+        first = line;
+    }
+    *sub = line - first;
+    return row;
+}
+
+// The line of row that column col (not counting line numbers) is on, and
+// in *start the column that line starts at
+int wrapSubOf(erow *row, int col, int *start) {
+    return wrapLineAt(row, col, wrapWidth(), start);
+}
+
+// The column the sub'th line of row starts at
+int wrapSubStart(erow *row, int sub) {
+    int width = wrapWidth();
+    if (!editorRowWide(row)) return sub * width;
+    int s = 0;
+    while (sub-- > 0) s = wrapNext(row, s, width);
+    return s;
+}
+
+void wrapSet(int on) {
+    E.wrap = on;
+    E.wrapoff = 0;
+    E.coloff = 0;
+    eventLoopRequestRedraw();
+}
+
+// A screen further down (dir 1) or up (-1), less two lines to keep some
+// context. Like paging without wrap, the cursor goes to the top line going
+// down and to the bottom line going up.
+void wrapPage(int dir) {
+    long long total = wrapLineOf(E.numrows);
+    long long top = wrapLineOf(E.rowoff) + E.wrapoff;
+    long long step = E.screenrows > 2 ? E.screenrows - 2 : 1;
+    long long line;
+    if (dir > 0) {
+        top += step;
+        if (top > total - E.screenrows) top = total - E.screenrows;
+        if (top < 0) top = 0;
+        line = top;
+    } else {
+        top -= step;
+        if (top < 0) top = 0;
+        line = top + E.screenrows - 1;
+        if (line > total - 1) line = total - 1;
+    }
+    E.rowoff = wrapRowAt(top, &E.wrapoff);
+    int sub;
+    E.cy = wrapRowAt(line, &sub);
+    E.cx = E.cy < E.numrows ? editorRxToCx(&E.row[E.cy], wrapSubStart(&E.row[E.cy], sub)) : 0;
+    E.cursor_pos = E.cx;
+}
@@ -0,0 +1,41 @@
+#ifndef WRAP_H_
+#define WRAP_H_
+
+#include "terminal.h"
+
+/* Soft wrap.
+ *
+ * With wrap on, a row takes as many screen lines as it needs at the width
+ * of the view, one more when it ends right at the edge so the cursor has
+ * somewhere to go. A wide character that would not fit at the end of a
+ * line starts the next one instead. Mapping between rows and those visual lines goes
+ * through a Fenwick tree of the line count of every row, kept per width
+ * for a few widths at once since views of one buffer may differ. Scrolling
+ * and paging are a couple of O(log n) lookups; an edit within a row
+ * recounts only that row. Rows coming and going shift every count after
+ * them, so the tree is rebuilt from the first of them on, from the counts
+ * already there, the next time it is asked.
+ */
+void wrapSet(int on);
+
+int wrapWidth(void);
+
+long long wrapLineOf(int row);
+
+int wrapRowAt(long long line, int *sub);
+
+int wrapSubOf(erow *row, int col, int *start);
+
+int wrapSubStart(erow *row, int sub);
+
+void wrapPage(int dir);
+
+void wrapRowChanged(erow *row);
+
+void wrapInsertRow(int at);
+
+void wrapDelRow(int at);
+
+void wrapFree(void);
+
+#endif